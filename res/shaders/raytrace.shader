@@ -12,28 +12,31 @@ void main() {
 	gl_Position = vec4(vertexPos.xyz, 1.0);
 }
 // --------------------------------------------------
-#shader fragment
-#version 430 core
+#shader common
+// shared by the fragment and compute stages, pasted in after their #version
 // like a lot of this code came from https://github.com/carl-vbn/opengl-raytracing/blob/main/shaders/fragment.glsl, modified to fit my project
 
 #define RENDER_DISTANCE 10000
 #define EPSILON 0.0001
 #define PI 3.1415926538
-
-in vec2 fragUV;
-out vec4 fragColor;
+#define BVH_STACK_SIZE 64
+#define RESERVOIR_NEIGHBOURS 3 // other pixels' reservoirs merged every pass, on top of this pixel's own
+#define RESERVOIR_RADIUS 0.03 // of the screen height, where the neighbours get picked from
+#define RESERVOIR_HISTORY 2 // passes worth of candidates a reused reservoir counts for at most, more makes passes too alike to accumulate
+#define RESERVOIR_REUSE_PASSES 8 // passes of an accumulation that merge reservoirs, the ones after are plain resampling without the bias
 
 struct Ray {
 	vec3 origin;
 	vec3 direction;
 };
 
+// the buffer structs are ordered so their std430 layout matches scene::gpuMaterial, gpuObject and gpuLight
 struct Material {
 	vec3 albedo;
-	vec3 emission;
-	vec3 specular;
 	float emissionStrength;
+	vec3 emission;
 	float roughness;
+	vec3 specular;
 	float specularHighlight;
 	float specularExponent;
 	bool transparent;
@@ -43,16 +46,17 @@ struct Material {
 struct SurfacePoint {
 	vec3 position;
 	vec3 normal;
-	Material material;
+	int material; // index into u_materials, only looked up once the hit is shaded
+	int object; // index into u_objects, -1 for the plane
 
 	bool frontFace;
 };
 
 struct Object {
-	uint type;
 	vec3 position;
+	uint type;
 	vec3 scale;
-	Material material;
+	int material;
 };
 
 struct PointLight {
@@ -63,29 +67,152 @@ struct PointLight {
 	float reach;
 };
 
+// flattened bvh built in bvh.cpp, interior nodes point at their first child (the second is right after it), leaves at a range of u_bvhIndices
+struct BVHNode {
+	vec3 boundsMin;
+	int leftFirst;
+	vec3 boundsMax;
+	int count;
+};
+
+layout(std430, binding = 0) readonly buffer BVHNodes {
+	BVHNode u_bvhNodes[];
+};
+
+layout(std430, binding = 1) readonly buffer BVHIndices {
+	uint u_bvhIndices[];
+};
+
+// the buffers only grow, so anything past u_objectCount / u_lightCount is stale
+layout(std430, binding = 2) readonly buffer Objects {
+	Object u_objects[];
+};
+
+layout(std430, binding = 3) readonly buffer Lights {
+	PointLight u_lights[];
+};
+
+// every material once, indexed by scene::object::mat
+layout(std430, binding = 4) readonly buffer Materials {
+	Material u_materials[];
+};
+
+// aliasTable built over the light weights (scene::buildLightTable), one entry per light
+struct AliasEntry {
+	float probability;
+	int alias;
+	float pdf;
+	float padding;
+};
+
+layout(std430, binding = 5) readonly buffer LightAliasTable {
+	AliasEntry u_lightAlias[];
+};
+
+// the light spheres in a tree of their own (scene::buildLightBVH), only walked by bounces that weigh lights against
+// their light samples. lights don't block anything so they stay out of the object tree
+layout(std430, binding = 7) readonly buffer LightBVHNodes {
+	BVHNode u_lightBVHNodes[];
+};
+
+layout(std430, binding = 8) readonly buffer LightBVHIndices {
+	uint u_lightBVHIndices[];
+};
+
+// objects with an emissive material (scene::findEmitters), they're sampled like lights and come right after them in
+// u_lightAlias and the light loop
+layout(std430, binding = 6) readonly buffer Emitters {
+	int u_emitters[];
+};
+
+// aliasTable over the cells of the skybox (skyboxDistribution), u_skyboxCells across and up
+layout(std430, binding = 9) readonly buffer SkyboxAliasTable {
+	AliasEntry u_skyboxAlias[];
+};
+
 uniform float u_aspectRatio;
 uniform vec3 u_cameraPos;
 uniform mat4 u_rotationMatrix;
-uniform float u_time; // seed
-uniform sampler2D u_screenTexture;
+uniform int u_seed; // every random number is a hash of this, the pixel, the pass and the dimension
 uniform sampler2D u_skyboxTexture;
-uniform bool u_directPass;
+uniform sampler2D u_blueNoiseTexture;
 uniform int u_accumulatedPasses;
 uniform float u_schlickPass;
 
-uniform int u_shadowResolution;
+uniform int u_shadowRays; // per light when every light is shaded
+uniform int u_lightSamples;
 uniform int u_lightBounces;
+uniform int u_rouletteDepth;
+uniform int u_samplerType;
 uniform float u_skyboxGamma;
 uniform float u_skyboxStrength;
 uniform bool u_planeVisible;
-uniform Material u_planeMaterial;
-uniform PointLight u_lights[4];
-uniform Object u_objects[64];
+uniform int u_planeMaterial;
+uniform int u_objectCount;
+uniform int u_lightCount;
+uniform int u_emitterCount;
+uniform int u_bvhNodeCount;
+uniform int u_lightBVHNodeCount;
+uniform ivec2 u_skyboxCells; // 0 when there's no table, then the sky is only found by escaping paths
 
-// https://thebookofshaders.com/10/
-float rand(vec2 seed) {
-	return fract(sin(dot(seed, vec2(12.9898, 78.233))) * 43758.5453123);
-}
+// per pixel light samples kept between passes for resampleLights (scene::gpuReservoir). u is the same 2d sample
+// sampleEmitter takes, so together with slot any pixel can evaluate it for itself
+// packed into 16 bytes, packReservoir has the layout
+struct Reservoir {
+	uint u; // the kept sample's point on the light
+	uint slotConfidence; // its light and M, how many candidates it stands for
+	float weight; // W, the candidates' total resampling weight / (M * target of the one kept), 0 once it's found occluded
+	uint normalDepth; // the surface it was made for, its normal and its distance from the camera
+};
+
+// two halves of u_screenSize pixels each, a pass writes the one the last pass didn't so neighbours are never read
+// while they're being written
+layout(std430, binding = 10) buffer Reservoirs {
+	Reservoir u_reservoirs[];
+};
+
+uniform ivec2 u_screenSize;
+uniform int u_reservoirCandidates; // 0 for no reservoirs, the first hit samples its lights like every other one
+
+// scene features, shader::selectVariant compiles programs with these as FEATURE_ defines (scene::getShaderDefines) so
+// the dead branches go away. they're only ever on or off, the counts behind them always come from the uniforms, or
+// every light added and every slider step would be a program of its own. the generic program has none of them and
+// reads the uniforms for everything, that's the one drawing while a specialized program is still compiling
+#ifdef FEATURE_PLANE
+#define PLANE_VISIBLE (FEATURE_PLANE != 0)
+#else
+#define PLANE_VISIBLE u_planeVisible
+#endif
+#ifdef FEATURE_TRANSPARENCY
+#define TRANSPARENT_MATERIALS (FEATURE_TRANSPARENCY != 0)
+#else
+#define TRANSPARENT_MATERIALS true
+#endif
+#ifdef FEATURE_LIGHTS
+#define LIGHT_COUNT (FEATURE_LIGHTS != 0 ? u_lightCount : 0)
+#else
+#define LIGHT_COUNT u_lightCount
+#endif
+#ifdef FEATURE_EMITTERS
+#define EMITTER_COUNT (FEATURE_EMITTERS != 0 ? u_emitterCount : 0)
+#else
+#define EMITTER_COUNT u_emitterCount
+#endif
+#ifdef FEATURE_LIGHT_SAMPLING
+#define LIGHT_SAMPLES (FEATURE_LIGHT_SAMPLING != 0 ? u_lightSamples : 0)
+#else
+#define LIGHT_SAMPLES u_lightSamples
+#endif
+#ifdef FEATURE_RESERVOIRS
+#define RESERVOIR_CANDIDATES (FEATURE_RESERVOIRS != 0 ? u_reservoirCandidates : 0)
+#else
+#define RESERVOIR_CANDIDATES u_reservoirCandidates
+#endif
+#define LIGHT_BOUNCES u_lightBounces
+
+// --------------------------------------------------
+#include "sampler.glsl"
+// --------------------------------------------------
 
 bool sphereIntersection(vec3 position, float radius, Ray ray, out float hitDistance) {
 	vec3 relativeOrigin = ray.origin - position;
@@ -164,49 +291,116 @@ bool planeIntersection(vec3 planeNormal, vec3 planePoint, Ray ray, out float hit
 	return false;
 }
 
+// slab test, entry gets clamped to 0 so rays that start inside a node still visit it
+bool boundsIntersection(vec3 boundsMin, vec3 boundsMax, Ray ray, vec3 invDir, float maxDistance, out float entry) {
+	vec3 t0s = (boundsMin - ray.origin) * invDir;
+	vec3 t1s = (boundsMax - ray.origin) * invDir;
+	vec3 tsmaller = min(t0s, t1s);
+	vec3 tbigger = max(t0s, t1s);
+
+	entry = max(max(tsmaller.x, tsmaller.y), max(tsmaller.z, 0.0));
+	float exitDist = min(min(tbigger.x, tbigger.y), min(tbigger.z, maxDistance));
+	return entry <= exitDist;
+}
+
+bool objectIntersection(uint i, Ray ray, out float hitDistance) {
+	if (u_objects[i].type == 1) return sphereIntersection(u_objects[i].position, u_objects[i].scale.x, ray, hitDistance);
+	if (u_objects[i].type == 2) return boxIntersection(u_objects[i].position, u_objects[i].scale, ray, hitDistance);
+	return false;
+}
+
 bool raycast(Ray ray, out SurfacePoint hitPoint) {
-	bool didHit = false;
 	float minHitDist = RENDER_DISTANCE; // so that no far objects get rendered on top of near objects
+	int hitObject = -1;
+	bool hitPlane = false;
 
 	float hitDist;
-	for (int i = 0; i < u_objects.length(); i++) {
-		if (u_objects[i].type == 0) continue; // object type none
-		if (u_objects[i].type == 1 && sphereIntersection(u_objects[i].position, u_objects[i].scale.x, ray, hitDist)) { // sphere
-			didHit = true;
-			if (hitDist < minHitDist) {
-				minHitDist = hitDist;
-				hitPoint.position = ray.origin + ray.direction * minHitDist;
-				vec3 outwardNormal = normalize(hitPoint.position - u_objects[i].position);
-				hitPoint.frontFace = dot(ray.direction, outwardNormal) < 0;
-				hitPoint.normal = hitPoint.frontFace ? outwardNormal : -outwardNormal;
-				hitPoint.material = u_objects[i].material;
+	if (u_bvhNodeCount > 0) {
+		vec3 invDir = 1.0 / ray.direction;
+		float entry;
+		int stack[BVH_STACK_SIZE];
+		int stackSize = 0;
+		if (boundsIntersection(u_bvhNodes[0].boundsMin, u_bvhNodes[0].boundsMax, ray, invDir, minHitDist, entry)) stack[stackSize++] = 0;
+
+		while (stackSize > 0) {
+			BVHNode node = u_bvhNodes[stack[--stackSize]];
+			if (node.count > 0) {
+				for (int j = 0; j < node.count; j++) {
+					uint i = u_bvhIndices[node.leftFirst + j];
+					if (objectIntersection(i, ray, hitDist) && hitDist < minHitDist) {
+						minHitDist = hitDist;
+						hitObject = int(i);
+					}
+				}
+				continue;
 			}
-		}
 
-		if (u_objects[i].type == 2 && boxIntersection(u_objects[i].position, u_objects[i].scale, ray, hitDist)) {
-			didHit = true;
-			if (hitDist < minHitDist) {
-				minHitDist = hitDist;
-				hitPoint.position = ray.origin + ray.direction * minHitDist;
-				vec3 outwardNormal = boxNormal(u_objects[i].position, u_objects[i].scale, ray.origin + ray.direction * minHitDist);
-				hitPoint.frontFace = dot(ray.direction, outwardNormal) < 0;
-				hitPoint.normal = hitPoint.frontFace ? outwardNormal : -outwardNormal;
-				hitPoint.material = u_objects[i].material;
+			float leftEntry, rightEntry;
+			bool hitLeft = boundsIntersection(u_bvhNodes[node.leftFirst].boundsMin, u_bvhNodes[node.leftFirst].boundsMax, ray, invDir, minHitDist, leftEntry);
+			bool hitRight = boundsIntersection(u_bvhNodes[node.leftFirst + 1].boundsMin, u_bvhNodes[node.leftFirst + 1].boundsMax, ray, invDir, minHitDist, rightEntry);
+			// far child goes on the stack first so the near one is visited next
+			if (hitLeft && hitRight) {
+				bool leftNear = leftEntry <= rightEntry;
+				stack[stackSize++] = leftNear ? node.leftFirst + 1 : node.leftFirst;
+				stack[stackSize++] = leftNear ? node.leftFirst : node.leftFirst + 1;
 			}
+			else if (hitLeft) stack[stackSize++] = node.leftFirst;
+			else if (hitRight) stack[stackSize++] = node.leftFirst + 1;
 		}
 	}
 
-	if (u_planeVisible && planeIntersection(vec3(0, 1, 0), vec3(0, 0, 0), ray, hitDist)) {
-		didHit = true;
-		if (hitDist < minHitDist) {
-			minHitDist = hitDist;
-			hitPoint.position = ray.origin + ray.direction * minHitDist;
-			hitPoint.normal = vec3(0, 1, 0);
-			hitPoint.material = u_planeMaterial;
-		}
+	if (PLANE_VISIBLE && planeIntersection(vec3(0, 1, 0), vec3(0, 0, 0), ray, hitDist) && hitDist < minHitDist) {
+		minHitDist = hitDist;
+		hitPlane = true;
+	}
+
+	// only the closest hit gets its normal and material index filled in
+	hitPoint.position = ray.origin + ray.direction * minHitDist;
+	if (hitPlane) {
+		hitPoint.normal = vec3(0, 1, 0);
+		hitPoint.frontFace = true;
+		hitPoint.material = u_planeMaterial;
+		hitPoint.object = -1;
 	}
+	else if (hitObject >= 0) {
+		vec3 outwardNormal = u_objects[hitObject].type == 1 ? normalize(hitPoint.position - u_objects[hitObject].position) : boxNormal(u_objects[hitObject].position, u_objects[hitObject].scale, hitPoint.position);
+		hitPoint.frontFace = dot(ray.direction, outwardNormal) < 0;
+		hitPoint.normal = hitPoint.frontFace ? outwardNormal : -outwardNormal;
+		hitPoint.material = u_objects[hitObject].material;
+		hitPoint.object = hitObject;
+	}
+
+	return hitPlane || hitObject >= 0;
+}
+
+// any hit query for shadow rays, returns on the first blocker nearer than maxDistance instead of searching for the closest one
+bool occluded(Ray ray, float maxDistance) {
+	maxDistance = min(maxDistance, RENDER_DISTANCE);
 
-	return didHit;
+	float hitDist;
+	if (PLANE_VISIBLE && planeIntersection(vec3(0, 1, 0), vec3(0, 0, 0), ray, hitDist) && hitDist < maxDistance) return true;
+	if (u_bvhNodeCount == 0) return false;
+
+	vec3 invDir = 1.0 / ray.direction;
+	float entry;
+	int stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	if (boundsIntersection(u_bvhNodes[0].boundsMin, u_bvhNodes[0].boundsMax, ray, invDir, maxDistance, entry)) stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		BVHNode node = u_bvhNodes[stack[--stackSize]];
+		if (node.count > 0) {
+			for (int j = 0; j < node.count; j++) {
+				if (objectIntersection(u_bvhIndices[node.leftFirst + j], ray, hitDist) && hitDist < maxDistance) return true;
+			}
+			continue;
+		}
+
+		// order doesn't matter when any hit will do
+		if (boundsIntersection(u_bvhNodes[node.leftFirst].boundsMin, u_bvhNodes[node.leftFirst].boundsMax, ray, invDir, maxDistance, entry)) stack[stackSize++] = node.leftFirst;
+		if (boundsIntersection(u_bvhNodes[node.leftFirst + 1].boundsMin, u_bvhNodes[node.leftFirst + 1].boundsMax, ray, invDir, maxDistance, entry)) stack[stackSize++] = node.leftFirst + 1;
+	}
+	return false;
 }
 
 // Adapted from https://bitbucket.org/Daerst/gpu-ray-tracing-in-unity/src/Tutorial_Pt2/Assets/RayTracingShader.compute
@@ -224,12 +418,12 @@ mat3x3 getTangentSpace(vec3 normal)
 }
 
 // Adapted from https://bitbucket.org/Daerst/gpu-ray-tracing-in-unity/src/Tutorial_Pt2/Assets/RayTracingShader.compute
-vec3 sampleHemisphere(vec3 normal, float alpha, vec2 seed)
+vec3 sampleHemisphere(vec3 normal, float alpha, vec2 u)
 {
 	// Sample the hemisphere, where alpha determines the kind of the sampling
-	float cosTheta = pow(rand(seed), 1.0 / (alpha + 1.0));
+	float cosTheta = pow(u.x, 1.0 / (alpha + 1.0));
 	float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
-	float phi = 2 * PI * rand(seed.yx);
+	float phi = 2 * PI * u.y;
 	vec3 tangentSpaceDir = vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
 
 	// Transform direction to world space
@@ -268,116 +462,615 @@ float reflectance(float cosine, float ref_idx) {
 	return r0 + (1 - r0) * pow((1 - cosine), 5);
 }
 
-vec3 directIllumination(SurfacePoint hitPoint, vec3 cameraPos, float seed) {
-	vec3 illumination = vec3(0);
-	for (int i = 0; i < u_lights.length(); i++) {
-		PointLight light = u_lights[i];
-		float lightDistance = length(light.position - hitPoint.position);
-		if (lightDistance > light.reach) continue;
-
-		// illumination = light_color * object_albedo * cos(angle_between_normal_and_light_direction) -> (dot(normal, light_direction))
-		float diffuse = clamp(dot(hitPoint.normal, normalize(light.position - hitPoint.position)), 0.0, 1.0);
-		if (diffuse > EPSILON || hitPoint.material.roughness < 1.0) {
-			// this is basically directly taken from https://github.com/carl-vbn/opengl-raytracing/blob/main/shaders/fragment.glsl because i dont know a better way to find the right amound of shadow rays
-			int shadowRays = int(u_shadowResolution * light.radius * light.radius / (lightDistance * lightDistance) + 1);
-			int shadowRayHits = 0;
-			for (int i = 0; i < shadowRays; i++) {
-				vec3 lightSurfacePoint = light.position + normalize(vec3(rand(vec2(i + seed, 1) + hitPoint.position.xy), rand(vec2(i + seed, 2) + hitPoint.position.yz), rand(vec2(i + seed, 3) + hitPoint.position.xz))) * light.radius;
-				vec3 lightDirection = normalize(lightSurfacePoint - hitPoint.position);
-				vec3 rayOrigin = hitPoint.position + lightDirection * EPSILON * 2.0;
-				float maxRayLength = length(lightSurfacePoint - rayOrigin);
-				Ray shadowRay = Ray(rayOrigin, lightDirection);
-				SurfacePoint shadowRayHit;
-				if (raycast(shadowRay, shadowRayHit)) {
-					if (length(shadowRayHit.position - rayOrigin) < maxRayLength) {
-						shadowRayHits += 1;
-					}
-				}
-			}
+// the scattering at a hit as both light sampling and the bounce see it. diffuse is albedo / pi and glossy the
+// normalized phong lobe around the mirror direction, each scaled by the chance calculateGI picks it with. perfect
+// mirrors and refraction only go through the bounce, nothing can sample their directions so they aren't in here.
+// transparent materials keep their old diffuse looking term for the light samples only, the bounce never draws it
+struct Bsdf {
+	vec3 normal;
+	vec3 reflected;
+	vec3 albedo;
+	vec3 specular;
+	float alpha;
+	float diffuseWeight; // scales albedo / pi when evaluating
+	float diffuseChance; // chance the bounce samples the diffuse lobe, 0 when it never does
+	float glossyChance; // 0 for perfect mirrors
+};
 
-			float attenuation = lightDistance * lightDistance;
-			illumination += light.color * light.power * diffuse * hitPoint.material.albedo * (1.0 - float(shadowRayHits) / shadowRays) / attenuation;
+Bsdf getBsdf(Material material, SurfacePoint hitPoint, vec3 rayDirection) {
+	Bsdf bsdf;
+	bsdf.normal = hitPoint.normal;
+	bsdf.reflected = reflect(rayDirection, hitPoint.normal);
+	bsdf.albedo = material.albedo;
+	bsdf.specular = material.specular;
+	float smoothness = 1.0 - material.roughness;
+	bsdf.alpha = pow(1000.0, smoothness * smoothness);
+	if (TRANSPARENT_MATERIALS && material.transparent) {
+		bsdf.diffuseWeight = 1.0;
+		bsdf.diffuseChance = 0.0;
+		bsdf.glossyChance = 0.0;
+		return bsdf;
+	}
+
+	float specChance = dot(material.specular, vec3(1.0 / 3.0));
+	float diffChance = dot(material.albedo, vec3(1.0 / 3.0));
+	float sum = specChance + diffChance;
+	bsdf.diffuseChance = sum > 0.0 ? diffChance / sum : 0.0;
+	bsdf.diffuseWeight = bsdf.diffuseChance;
+	bsdf.glossyChance = sum > 0.0 && smoothness < 1.0 ? specChance / sum : 0.0;
+	return bsdf;
+}
+
+// f * cos towards dir
+vec3 evalBsdf(Bsdf bsdf, vec3 dir) {
+	float cosTheta = dot(bsdf.normal, dir);
+	if (cosTheta <= 0.0) return vec3(0);
+	vec3 f = bsdf.diffuseWeight * bsdf.albedo / PI;
+	if (bsdf.glossyChance > 0.0) f += bsdf.glossyChance * bsdf.specular * (bsdf.alpha + 2.0) / (2.0 * PI) * pow(max(dot(bsdf.reflected, dir), 0.0), bsdf.alpha);
+	return f * cosTheta;
+}
+
+// density of the bounce in calculateGI picking dir, over solid angle
+float bsdfPdf(Bsdf bsdf, vec3 dir) {
+	float pdf = bsdf.diffuseChance * max(dot(bsdf.normal, dir), 0.0) / PI;
+	if (bsdf.glossyChance > 0.0) pdf += bsdf.glossyChance * (bsdf.alpha + 1.0) / (2.0 * PI) * pow(max(dot(bsdf.reflected, dir), 0.0), bsdf.alpha);
+	return pdf;
+}
+
+// Veach's power heuristic with beta = 2, the weight of the strategy with pdf a against the one with pdf b
+float powerHeuristic(float a, float b) {
+	if (a <= 0.0) return 0.0;
+	return a * a / (a * a + b * b);
+}
+
+// density of sampleSkyboxLight picking dir, over solid angle. a cell is uniform in uv and a bit of uv covers
+// 2 pi^2 cos(elevation) of solid angle
+float skyboxPdf(vec3 dir) {
+	int cells = u_skyboxCells.x * u_skyboxCells.y;
+	float cosElevation = sqrt(max(1.0 - dir.y * dir.y, 0.0));
+	if (u_skyboxStrength == 0.0 || cells == 0 || cosElevation <= 0.0) return 0.0;
+	vec2 uv = vec2(0.5 + atan(dir.x, dir.z) / (2 * PI), 0.5 + asin(clamp(dir.y, -1.0, 1.0)) / PI);
+	ivec2 cell = clamp(ivec2(uv * vec2(u_skyboxCells)), ivec2(0), u_skyboxCells - 1);
+	return u_skyboxAlias[cell.y * u_skyboxCells.x + cell.x].pdf * float(cells) / (2 * PI * PI * cosElevation);
+}
+
+// one shadow ray towards the sky, at a cell picked by brightness from u_skyboxAlias and then anywhere in it. weighed
+// against the bounce escaping the same way. transparent materials and perfect mirrors only ever see the sky through
+// their bounce, same as before
+vec3 sampleSkyboxLight(SurfacePoint hitPoint, Bsdf bsdf, int bounce) {
+	int cells = u_skyboxCells.x * u_skyboxCells.y;
+	if (u_skyboxStrength == 0.0 || cells == 0 || bsdf.diffuseChance + bsdf.glossyChance <= 0.0) return vec3(0);
+
+	vec2 pick = get2D(bounceDimension(bounce, SAMPLER_SKYBOX));
+	int bucket = min(int(pick.x * float(cells)), cells - 1);
+	int cell = pick.y < u_skyboxAlias[bucket].probability ? bucket : u_skyboxAlias[bucket].alias;
+	vec2 uv = (vec2(cell % u_skyboxCells.x, cell / u_skyboxCells.x) + get2D(bounceDimension(bounce, SAMPLER_SKYBOX + 1u))) / vec2(u_skyboxCells);
+	// the inverse of the mapping in sampleSkybox, u is the azimuth and v the elevation
+	float azimuth = (uv.x - 0.5) * 2 * PI;
+	float elevation = (uv.y - 0.5) * PI;
+	float cosElevation = cos(elevation);
+	if (cosElevation <= 0.0) return vec3(0);
+	vec3 direction = vec3(cosElevation * sin(azimuth), sin(elevation), cosElevation * cos(azimuth));
+	float pdf = u_skyboxAlias[cell].pdf * float(cells) / (2 * PI * PI * cosElevation);
+
+	vec3 f = evalBsdf(bsdf, direction);
+	if (f == vec3(0)) return vec3(0);
+	if (occluded(Ray(hitPoint.position + direction * EPSILON * 2.0, direction), RENDER_DISTANCE)) return vec3(0);
+	return f * sampleSkybox(direction) * powerHeuristic(pdf, bsdfPdf(bsdf, direction)) / pdf;
+}
+
+// a direction picked uniformly inside the cone a sphere covers as seen from position (solid angle sampling), returns
+// the pdf over solid angle and the distance to the sphere's near side along it (the far side from inside)
+float sampleSphereCone(vec3 center, float radius, vec3 position, vec2 u, out vec3 direction, out float surfaceDistance) {
+	vec3 toCenter = center - position;
+	float centerDistance = length(toCenter);
+	float sinThetaMax2 = min(radius * radius / (centerDistance * centerDistance), 1.0);
+	float cosThetaMax = sqrt(1.0 - sinThetaMax2);
+	float oneMinusCosThetaMax = sinThetaMax2 / (1.0 + cosThetaMax); // 1 - cos without the cancellation for small spheres
+	float cosTheta = 1.0 - u.x * oneMinusCosThetaMax;
+	float sinTheta = sqrt(max(0.0, 1.0 - cosTheta * cosTheta));
+	float phi = 2 * PI * u.y;
+	direction = getTangentSpace(toCenter / centerDistance) * vec3(cos(phi) * sinTheta, sin(phi) * sinTheta, cosTheta);
+
+	float halfChord = sqrt(max(radius * radius - centerDistance * centerDistance * sinTheta * sinTheta, 0.0));
+	surfaceDistance = centerDistance * cosTheta - halfChord;
+	if (surfaceDistance <= 0.0) surfaceDistance = centerDistance * cosTheta + halfChord;
+	return 1.0 / (2.0 * PI * oneMinusCosThetaMax);
+}
+
+float sphereConePdf(vec3 center, float radius, vec3 position) {
+	float centerDistance = length(center - position);
+	float sinThetaMax2 = min(radius * radius / (centerDistance * centerDistance), 1.0);
+	return 1.0 / (2.0 * PI * sinThetaMax2 / (1.0 + sqrt(1.0 - sinThetaMax2)));
+}
+
+// area of the box faces that face position, one axis per component
+vec3 visibleBoxFaces(vec3 center, vec3 scale, vec3 position) {
+	return vec3(scale.y * scale.z, scale.x * scale.z, scale.x * scale.y) * step(scale / 2.0, abs(position - center));
+}
+
+// a point picked uniformly over the faces of a box that face position, returns the pdf converted to solid angle
+float sampleBox(vec3 center, vec3 scale, vec3 position, vec2 u, out vec3 direction, out float surfaceDistance) {
+	vec3 faces = visibleBoxFaces(center, scale, position);
+	float area = faces.x + faces.y + faces.z;
+	if (area <= 0.0) return 0.0;
+
+	// u.x picks the face by area and is then stretched back over that face
+	float pick = u.x * area;
+	// rounding can push pick past the last face, so a face with no area is never the one picked
+	int axis = faces.z > 0.0 && pick >= faces.x + faces.y ? 2 : (faces.y > 0.0 && pick >= faces.x ? 1 : 0);
+	float start = axis == 0 ? 0.0 : (axis == 1 ? faces.x : faces.x + faces.y);
+	vec2 uv = vec2(clamp((pick - start) / faces[axis], 0.0, 1.0), u.y);
+
+	vec3 point = center;
+	point[axis] += sign(position[axis] - center[axis]) * scale[axis] / 2.0;
+	point[(axis + 1) % 3] += (uv.x - 0.5) * scale[(axis + 1) % 3];
+	point[(axis + 2) % 3] += (uv.y - 0.5) * scale[(axis + 2) % 3];
+
+	vec3 toPoint = point - position;
+	surfaceDistance = length(toPoint);
+	direction = toPoint / surfaceDistance;
+	float cosLight = abs(direction[axis]);
+	if (cosLight <= EPSILON) return 0.0;
+	return surfaceDistance * surfaceDistance / (area * cosLight);
+}
+
+float boxPdf(vec3 center, vec3 scale, vec3 position, vec3 direction, SurfacePoint hitPoint) {
+	vec3 faces = visibleBoxFaces(center, scale, position);
+	float area = faces.x + faces.y + faces.z;
+	float cosLight = abs(dot(direction, hitPoint.normal));
+	if (area <= 0.0 || cosLight <= EPSILON) return 0.0;
+	float hitDistance = length(hitPoint.position - position);
+	return hitDistance * hitDistance / (area * cosLight);
+}
 
-			// specular highlights
-			vec3 lightDir = normalize(hitPoint.position - light.position);
+// how many light samples a shading point spends on slot, times the chance of each one picking it. the estimate of one
+// sample gets divided by this times its own pdf, and the bounce weighs itself against the same product
+float emitterSamples(int slot) {
+	if (LIGHT_SAMPLES > 0) return float(LIGHT_SAMPLES) * u_lightAlias[slot].pdf;
+	return float(max(u_shadowRays, 1));
+}
+
+// a light sample towards slot at u, before any mis weight or sample count. the light gets through as f * radiance / pdf
+// when the shadow ray is clear, the highlight doesn't care. pdf is over solid angle and 0 for a point light since
+// nothing else can reach one
+struct LightSample {
+	vec3 highlight;
+	vec3 contribution;
+	vec3 direction;
+	float distance; // the shadow ray's length
+	float pdf;
+};
+
+// the lights first and then the emissive objects. a light is a sphere giving off color * power / r^2, so far away it
+// adds the same color * power * albedo * cos / d^2 it always did, and a light with no radius is still a point
+LightSample evalEmitter(int slot, SurfacePoint hitPoint, Bsdf bsdf, Material material, vec3 cameraPos, vec2 u) {
+	LightSample s = LightSample(vec3(0), vec3(0), vec3(0, 1, 0), 0.0, 0.0);
+	vec3 radiance;
+	float surfaceDistance;
+	if (slot < LIGHT_COUNT) {
+		PointLight light = u_lights[slot];
+		vec3 toLight = light.position - hitPoint.position;
+		float lightDistance = length(toLight);
+		if (lightDistance > light.reach) return s;
+
+		// specular highlights, from the center and not shadowed like before. skipped outright without one since a hit
+		// right on top of the last could make cameraDir nan
+		float diffuse = clamp(dot(hitPoint.normal, toLight / lightDistance), 0.0, 1.0);
+		if (material.specularHighlight > 0.0 && (diffuse > EPSILON || material.roughness < 1.0)) {
+			float attenuation = lightDistance * lightDistance;
+			vec3 lightDir = -toLight / lightDistance;
 			vec3 reflectedLightDir = reflect(lightDir, hitPoint.normal);
 			vec3 cameraDir = normalize(cameraPos - hitPoint.position);
 			// https://en.wikipedia.org/wiki/Specular_highlight and basically ripped from https://github.com/carl-vbn/opengl-raytracing/blob/main/shaders/fragment.glsl but I made sure I understood it before using it obviously
-			illumination += hitPoint.material.specularHighlight * light.color * light.power / attenuation * pow(max(dot(cameraDir, reflectedLightDir), 0.0), 1.0 / max(hitPoint.material.specularExponent, EPSILON));
+			s.highlight = material.specularHighlight * light.color * light.power / attenuation * pow(max(dot(cameraDir, reflectedLightDir), 0.0), 1.0 / max(material.specularExponent, EPSILON));
+		}
+
+		if (light.radius <= EPSILON) {
+			s.direction = toLight / lightDistance;
+			s.distance = lightDistance - EPSILON * 2.0;
+			s.contribution = evalBsdf(bsdf, s.direction) * light.color * light.power * PI / (lightDistance * lightDistance);
+			return s;
+		}
+		s.pdf = sampleSphereCone(light.position, light.radius, hitPoint.position, u, s.direction, surfaceDistance);
+		radiance = light.color * light.power / (light.radius * light.radius);
+	}
+	else {
+		int object = u_emitters[slot - LIGHT_COUNT];
+		if (object == hitPoint.object) return s;
+		Object emitter = u_objects[object];
+		Material emitterMaterial = u_materials[emitter.material];
+		radiance = emitterMaterial.emission * emitterMaterial.emissionStrength;
+		if (emitter.type == 1) s.pdf = sampleSphereCone(emitter.position, emitter.scale.x, hitPoint.position, u, s.direction, surfaceDistance);
+		else s.pdf = sampleBox(emitter.position, emitter.scale, hitPoint.position, u, s.direction, surfaceDistance);
+	}
+	if (s.pdf <= 0.0) {
+		s.pdf = 0.0;
+		return s;
+	}
+
+	// 2 epsilon off the surface at the start and 2 short of the emitter at the end, so neither one shadows itself
+	s.distance = surfaceDistance - EPSILON * 4.0;
+	s.contribution = evalBsdf(bsdf, s.direction) * radiance / s.pdf;
+	return s;
+}
+
+bool lightSampleVisible(SurfacePoint hitPoint, LightSample s) {
+	return !occluded(Ray(hitPoint.position + s.direction * EPSILON * 2.0, s.direction), s.distance);
+}
+
+// one light sample towards slot, weighed against the bounce finding the same light unless it's a point
+vec3 sampleEmitter(int slot, SurfacePoint hitPoint, Bsdf bsdf, Material material, vec3 cameraPos, vec2 u) {
+	float samples = emitterSamples(slot);
+	if (samples <= 0.0) return vec3(0);
+
+	LightSample s = evalEmitter(slot, hitPoint, bsdf, material, cameraPos, u);
+	vec3 illumination = s.highlight / samples;
+	if (s.contribution == vec3(0) || !lightSampleVisible(hitPoint, s)) return illumination;
+	float weight = s.pdf > 0.0 ? powerHeuristic(samples * s.pdf, bsdfPdf(bsdf, s.direction)) : 1.0;
+	return illumination + s.contribution * weight / samples;
+}
+
+// LIGHT_SAMPLES lights and emitters picked from u_lightAlias by power with one shadow ray each, every one weighted by
+// 1 / pdf so on average it comes out the same as the loop over all of them, but the cost doesn't grow with the count
+vec3 sampleLights(SurfacePoint hitPoint, Bsdf bsdf, Material material, vec3 cameraPos, int bounce) {
+	int count = LIGHT_COUNT + EMITTER_COUNT;
+	if (count == 0) return vec3(0);
+	vec3 illumination = vec3(0);
+	for (int s = 0; s < LIGHT_SAMPLES; s++) {
+		// x picks the bucket and y decides between it and its alias
+		vec2 pick = get2D(lightDimension(bounce, uint(2 * s)));
+		int bucket = min(int(pick.x * float(count)), count - 1);
+		int slot = pick.y < u_lightAlias[bucket].probability ? bucket : u_lightAlias[bucket].alias;
+		illumination += sampleEmitter(slot, hitPoint, bsdf, material, cameraPos, get2D(lightDimension(bounce, uint(2 * s + 1))));
+	}
+	return illumination;
+}
+
+// https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+// two snorm8s in the low 16 bits, plenty for telling surfaces apart
+uint packNormal(vec3 n) {
+	vec2 p = n.xy / (abs(n.x) + abs(n.y) + abs(n.z));
+	if (n.z < 0.0) p = (1.0 - abs(p.yx)) * vec2(p.x >= 0.0 ? 1.0 : -1.0, p.y >= 0.0 ? 1.0 : -1.0);
+	return packSnorm4x8(vec4(p, 0.0, 0.0)) & 0xffffu;
+}
+
+vec3 unpackNormal(uint bits) {
+	vec2 p = unpackSnorm4x8(bits).xy;
+	vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+	if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
+// u as two unorm16s, the slot in the low 20 bits with M (at most 9 * 32 candidates) above it, and the depth as a half
+// next to the normal. the depth and normal only get compared with a lot of slack, so losing precision there is free
+Reservoir packReservoir(vec2 u, int slot, float confidence, float weight, float depth, vec3 normal) {
+	return Reservoir(packUnorm2x16(u), uint(slot) | uint(confidence) << 20, weight, packNormal(normal) | packHalf2x16(vec2(0.0, depth)));
+}
+
+int reservoirSlot(Reservoir r) {
+	return int(r.slotConfidence & 0xfffffu);
+}
+
+float reservoirConfidence(Reservoir r) {
+	return float(r.slotConfidence >> 20);
+}
+
+float reservoirDepth(Reservoir r) {
+	return unpackHalf2x16(r.normalDepth).y;
+}
+
+// what resampling aims for, the unshadowed light a sample brings as luminance
+float lightSampleTarget(LightSample s) {
+	return dot(s.contribution, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// the reservoirs only stand in for the light samples' share of an area light, the bounce still weighs itself against
+// emitterSamples the same as always and picks up the rest. glossy reflections of small lights need that side
+LightSample evalResampledEmitter(int slot, SurfacePoint hitPoint, Bsdf bsdf, Material material, vec3 cameraPos, vec2 u) {
+	LightSample s = evalEmitter(slot, hitPoint, bsdf, material, cameraPos, u);
+	if (s.pdf > 0.0) s.contribution *= powerHeuristic(emitterSamples(slot) * s.pdf, bsdfPdf(bsdf, s.direction));
+	return s;
+}
+
+// the choices between reservoir samples, they don't need to be stratified so it's just a hash chain per pixel and pass
+float reservoirRandom(inout uint state) {
+	state = hash(state);
+	return toFloat(state);
+}
+
+// reservoir resampling for the first hit in place of sampleLights (ReSTIR, Bitterli et al. 2020). candidates get picked
+// by power like sampleLights and one is kept by how much light it brings here, with a shadow ray so an occluded pick
+// isn't passed on (visibility reuse). then it's merged with this pixel's reservoir from the last pass and a few
+// neighbours' (temporal and spatial reuse), every reused sample weighed by what it's worth here. reservoirs made for a
+// surface facing elsewhere or at another depth are skipped. merged with 1 / M like the paper's biased version, which
+// darkens the edges of shadows a touch, so that only happens for the first RESERVOIR_REUSE_PASSES of an accumulation
+// to get it close to converged quickly. the passes after that keep the candidates and the shadow ray but don't merge,
+// which is unbiased, so the accumulated image still ends up at the reference. the reservoirs get cleared whenever the
+// accumulation starts over. highlights stay unshadowed like everywhere else, so they're just averaged over the
+// candidates instead of going through the reservoir
+vec3 resampleLights(SurfacePoint hitPoint, Bsdf bsdf, Material material, vec3 cameraPos) {
+	int count = LIGHT_COUNT + EMITTER_COUNT;
+	int pixelCount = u_screenSize.x * u_screenSize.y;
+	int pixel = int(samplerPixel.y) * u_screenSize.x + int(samplerPixel.x);
+	int previous = ((u_accumulatedPasses + 1) & 1) * pixelCount;
+	int current = (u_accumulatedPasses & 1) * pixelCount;
+	uint rng = hashCombine(samplerPixelHash, samplerIndex);
+	float depth = length(hitPoint.position - cameraPos);
+
+	vec2 keptU = vec2(0);
+	int keptSlot = 0;
+	float confidence = 0.0;
+	float weightSum = 0.0;
+	float target = 0.0;
+	vec3 highlights = vec3(0);
+	LightSample chosen;
+	for (int c = 0; c < RESERVOIR_CANDIDATES; c++) {
+		vec2 pick = get2D(lightDimension(0, uint(2 * c)));
+		int bucket = min(int(pick.x * float(count)), count - 1);
+		int slot = pick.y < u_lightAlias[bucket].probability ? bucket : u_lightAlias[bucket].alias;
+		vec2 u = get2D(lightDimension(0, uint(2 * c + 1)));
+		float sourcePdf = u_lightAlias[slot].pdf;
+		LightSample s = evalResampledEmitter(slot, hitPoint, bsdf, material, cameraPos, u);
+		float sampleTarget = lightSampleTarget(s);
+		float w = sourcePdf > 0.0 ? sampleTarget / sourcePdf : 0.0;
+		if (sourcePdf > 0.0) highlights += s.highlight / (sourcePdf * float(RESERVOIR_CANDIDATES));
+		confidence += 1.0;
+		weightSum += w;
+		if (reservoirRandom(rng) * weightSum < w) {
+			keptSlot = slot;
+			keptU = u;
+			target = sampleTarget;
+			chosen = s;
 		}
 	}
+
+	// visibility reuse, the pick only counts for its neighbours and the next pass if it reaches this pixel
+	bool visible = target > 0.0 && lightSampleVisible(hitPoint, chosen);
+	if (!visible) weightSum = 0.0;
+
+	// -1 is this pixel's own reservoir, the rest are picked in a disc around it
+	int neighbours = u_accumulatedPasses < RESERVOIR_REUSE_PASSES ? RESERVOIR_NEIGHBOURS : -1;
+	for (int n = -1; n < neighbours; n++) {
+		ivec2 other = ivec2(samplerPixel);
+		if (n >= 0) {
+			float angle = 2 * PI * reservoirRandom(rng);
+			float radius = RESERVOIR_RADIUS * float(u_screenSize.y) * sqrt(reservoirRandom(rng));
+			other += ivec2(round(vec2(cos(angle), sin(angle)) * radius));
+			if (any(lessThan(other, ivec2(0))) || any(greaterThanEqual(other, u_screenSize))) continue;
+		}
+		Reservoir q = u_reservoirs[previous + other.y * u_screenSize.x + other.x];
+		// empty and occluded reservoirs aren't reused at all, merging their M in darkens lit pixels next to shadows
+		int slot = reservoirSlot(q);
+		if (q.weight <= 0.0 || slot >= count || abs(reservoirDepth(q) - depth) > 0.1 * depth || dot(unpackNormal(q.normalDepth), hitPoint.normal) < 0.9) continue;
+
+		vec2 u = unpackUnorm2x16(q.u);
+		LightSample s = evalResampledEmitter(slot, hitPoint, bsdf, material, cameraPos, u);
+		float sampleTarget = lightSampleTarget(s);
+		float qConfidence = min(reservoirConfidence(q), float(RESERVOIR_HISTORY * RESERVOIR_CANDIDATES));
+		float w = sampleTarget * q.weight * qConfidence;
+		confidence += qConfidence;
+		weightSum += w;
+		if (reservoirRandom(rng) * weightSum < w) {
+			keptSlot = slot;
+			keptU = u;
+			target = sampleTarget;
+			chosen = s;
+			visible = false; // not checked from here yet
+		}
+	}
+
+	vec3 illumination = highlights;
+	float weight = 0.0;
+	if (target > 0.0 && weightSum > 0.0) {
+		weight = weightSum / (confidence * target);
+		if (visible || lightSampleVisible(hitPoint, chosen)) illumination += chosen.contribution * weight;
+		else weight = 0.0;
+	}
+	// nothing reads it once the reuse is over
+	if (u_accumulatedPasses + 1 < RESERVOIR_REUSE_PASSES) u_reservoirs[current + pixel] = packReservoir(keptU, keptSlot, confidence, weight, depth, hitPoint.normal);
 	return illumination;
 }
 
+// LIGHT_SAMPLES lights picked by power, so the shadow rays per point don't grow with the light count. 0 opts into every
+// light and emitter with u_shadowRays samples each, the cost is fixed per light no matter how close it is. the sky
+// gets one sample either way, and the first hit resamples its lights instead when there are reservoirs
+vec3 directIllumination(SurfacePoint hitPoint, Bsdf bsdf, vec3 cameraPos, int bounce) {
+	Material material = u_materials[hitPoint.material];
+	vec3 illumination = sampleSkyboxLight(hitPoint, bsdf, bounce);
+	if (bounce == 0 && RESERVOIR_CANDIDATES > 0 && LIGHT_COUNT + EMITTER_COUNT > 0) return illumination + resampleLights(hitPoint, bsdf, material, cameraPos);
+	if (LIGHT_SAMPLES > 0) return illumination + sampleLights(hitPoint, bsdf, material, cameraPos, bounce);
+
+	int shadowRays = max(u_shadowRays, 1);
+	for (int slot = 0; slot < LIGHT_COUNT + EMITTER_COUNT; slot++) {
+		// every shadow ray is its own sample of this light's dimension so they stay stratified against each other
+		uint dimension = lightDimension(bounce, uint(slot));
+		for (int j = 0; j < shadowRays; j++) {
+			illumination += sampleEmitter(slot, hitPoint, bsdf, material, cameraPos, sample2D(samplerIndex * uint(shadowRays) + uint(j), dimension));
+		}
+	}
+	return illumination;
+}
+
+// the emitter's side of the weight when a bounce lands on an emissive object, the density of the light samples
+// picking the same direction
+float emitterPdf(int object, Ray ray, SurfacePoint hitPoint) {
+	for (int e = 0; e < EMITTER_COUNT; e++) {
+		if (u_emitters[e] != object) continue;
+		Object emitter = u_objects[object];
+		float pdf = emitter.type == 1 ? sphereConePdf(emitter.position, emitter.scale.x, ray.origin) : boxPdf(emitter.position, emitter.scale, ray.origin, ray.direction, hitPoint);
+		return emitterSamples(LIGHT_COUNT + e) * pdf;
+	}
+	return 0.0;
+}
+
+// what a ray picks up on its way to hitPoint (hit is false for a miss). lastPdf is the density the bounce that
+// made it had, 0 for the camera ray, refraction and perfect mirrors. after those the emission counts in full and
+// the lights stay invisible like they always were, after any other bounce both get weighed against the light samples
+vec3 emissionAlongRay(Ray ray, bool hit, SurfacePoint hitPoint, float lastPdf) {
+	vec3 emission = vec3(0);
+	float hitDistance = RENDER_DISTANCE;
+	if (hit) {
+		Material material = u_materials[hitPoint.material];
+		vec3 emitted = material.emission * material.emissionStrength;
+		if (emitted != vec3(0)) {
+			float weight = lastPdf > 0.0 && hitPoint.object >= 0 ? powerHeuristic(lastPdf, emitterPdf(hitPoint.object, ray, hitPoint)) : 1.0;
+			emission += emitted * weight;
+		}
+		hitDistance = length(hitPoint.position - ray.origin);
+	}
+	if (lastPdf <= 0.0) return emission;
+
+	// lights don't block anything, so every one the ray passes through before the hit counts and the order doesn't matter
+	if (u_lightBVHNodeCount == 0) return emission;
+	vec3 invDir = 1.0 / ray.direction;
+	float entry;
+	int stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+	if (boundsIntersection(u_lightBVHNodes[0].boundsMin, u_lightBVHNodes[0].boundsMax, ray, invDir, hitDistance, entry)) stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		BVHNode node = u_lightBVHNodes[stack[--stackSize]];
+		if (node.count > 0) {
+			for (int j = 0; j < node.count; j++) {
+				int i = int(u_lightBVHIndices[node.leftFirst + j]);
+				PointLight light = u_lights[i];
+				float lightDistance;
+				if (length(light.position - ray.origin) > light.reach) continue;
+				if (!sphereIntersection(light.position, light.radius, ray, lightDistance) || lightDistance >= hitDistance) continue;
+				float lightPdf = emitterSamples(i) * sphereConePdf(light.position, light.radius, ray.origin);
+				emission += light.color * light.power / (light.radius * light.radius) * powerHeuristic(lastPdf, lightPdf);
+			}
+			continue;
+		}
+
+		if (boundsIntersection(u_lightBVHNodes[node.leftFirst].boundsMin, u_lightBVHNodes[node.leftFirst].boundsMax, ray, invDir, hitDistance, entry)) stack[stackSize++] = node.leftFirst;
+		if (boundsIntersection(u_lightBVHNodes[node.leftFirst + 1].boundsMin, u_lightBVHNodes[node.leftFirst + 1].boundsMax, ray, invDir, hitDistance, entry)) stack[stackSize++] = node.leftFirst + 1;
+	}
+	return emission;
+}
+
+// what a path does after a hit, picked by the roulette on the material's albedo and specular
+#define BOUNCE_REFRACT 0
+#define BOUNCE_SPECULAR 1
+#define BOUNCE_DIFFUSE 2
+#define BOUNCE_ABSORB 3
+
+int chooseBounce(SurfacePoint hitPoint, int bounce) {
+	Material material = u_materials[hitPoint.material];
+	if (TRANSPARENT_MATERIALS && material.transparent) return BOUNCE_REFRACT;
+
+	float specChance = dot(material.specular, vec3(1.0 / 3.0));
+	float diffChance = dot(material.albedo, vec3(1.0 / 3.0));
+
+	float sum = specChance + diffChance;
+	specChance /= sum;
+	diffChance /= sum;
+
+	float roulette = get1D(bounceDimension(bounce, SAMPLER_BOUNCE_TYPE));
+	if (roulette < specChance) return BOUNCE_SPECULAR;
+	if (diffChance > 0 && roulette < sum) return BOUNCE_DIFFUSE;
+	return BOUNCE_ABSORB;
+}
+
+// refraction (super cool)
+void refractBounce(SurfacePoint hitPoint, inout vec3 rayOrigin, inout vec3 rayDirection, inout vec3 energy) {
+	Material material = u_materials[hitPoint.material];
+	float refractionRatio = hitPoint.frontFace ? (1.0 / material.refractiveIndex) : material.refractiveIndex;
+	float cosTheta = min(dot(-rayDirection, hitPoint.normal), 1.0);
+	float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
+
+	if (refractionRatio * sinTheta > 1.0 || reflectance(cosTheta, refractionRatio) > u_schlickPass) {
+		rayDirection = reflect(rayDirection, hitPoint.normal);
+	}
+	else {
+		rayDirection = refract(rayDirection, hitPoint.normal, refractionRatio);
+	}
+	rayOrigin = hitPoint.position + rayDirection * EPSILON;
+	energy *= material.albedo;
+}
+
+// the bounces leave the pdf of the direction they picked in lastPdf, 0 when light sampling couldn't have picked it
+void specularBounce(SurfacePoint hitPoint, Bsdf bsdf, vec2 u, inout vec3 rayOrigin, inout vec3 rayDirection, inout vec3 energy, inout float lastPdf) {
+	Material material = u_materials[hitPoint.material];
+	float smoothness = 1.0 - material.roughness;
+	float alpha = pow(1000.0, smoothness * smoothness);
+	if (smoothness == 1.0) {
+		rayDirection = reflect(rayDirection, hitPoint.normal);
+	}
+	else {
+		rayDirection = sampleHemisphere(reflect(rayDirection, hitPoint.normal), alpha, u);
+		lastPdf = bsdfPdf(bsdf, rayDirection);
+	}
+	rayOrigin = hitPoint.position + rayDirection * EPSILON;
+	float f = (alpha + 2) / (alpha + 1);
+	energy *= material.specular * max(dot(hitPoint.normal, rayDirection) * f, 0.0);
+}
+
+void diffuseBounce(SurfacePoint hitPoint, Bsdf bsdf, vec2 u, inout vec3 rayOrigin, inout vec3 rayDirection, inout vec3 energy, inout float lastPdf) {
+	rayOrigin = hitPoint.position + hitPoint.normal * EPSILON;
+	rayDirection = sampleHemisphere(hitPoint.normal, 1.0, u);
+	lastPdf = bsdfPdf(bsdf, rayDirection);
+	// cosine weighted, so albedo / pi * cos over the pdf of cos / pi leaves just the albedo
+	energy *= u_materials[hitPoint.material].albedo;
+}
+
+// russian roulette, past u_rouletteDepth bounces a path survives with a chance based on the energy it has left
+// and the survivors get scaled up by the same amount so the average stays the same
+bool russianRoulette(int bounce, inout vec3 energy) {
+	// a glossy sample below the surface leaves nothing to carry, and the next hit could be right on top of this one
+	if (energy == vec3(0)) return false;
+	if (bounce < u_rouletteDepth) return true;
+	float survival = min(max(energy.r, max(energy.g, energy.b)), 1.0);
+	if (get1D(bounceDimension(bounce, SAMPLER_RUSSIAN_ROULETTE)) >= survival) return false;
+	energy /= survival;
+	return true;
+}
+
 // yeah so glsl prohibits recursion so thats cool
-vec3 calculateGI(Ray cameraRay, float seed) {
+vec3 calculateGI(Ray cameraRay) {
 	vec3 gi = vec3(0);
 	vec3 rayOrigin = cameraRay.origin;
 	vec3 rayDirection = cameraRay.direction;
 	vec3 energy = vec3(1);
-	for (int i = 0; i < u_lightBounces; i++) {
+	float lastPdf = 0.0;
+	for (int i = 0; i < LIGHT_BOUNCES; i++) {
 		SurfacePoint hitPoint;
-		if (raycast(Ray(rayOrigin, rayDirection), hitPoint)) {
-			// emission
-			gi += energy * hitPoint.material.emission * hitPoint.material.emissionStrength;
+		Ray ray = Ray(rayOrigin, rayDirection);
+		bool hit = raycast(ray, hitPoint);
+
+		// emission
+		gi += energy * emissionAlongRay(ray, hit, hitPoint, lastPdf);
+
+		if (hit) {
+			Material material = u_materials[hitPoint.material];
+			Bsdf bsdf = getBsdf(material, hitPoint, rayDirection);
 
 			// DI
-			gi += energy * directIllumination(hitPoint, rayOrigin, seed);
+			gi += energy * directIllumination(hitPoint, bsdf, rayOrigin, i);
 
 			// II
-			if (hitPoint.material.transparent) {
-				// refraction (super cool)
-				float refractionRatio = hitPoint.frontFace ? (1.0 / hitPoint.material.refractiveIndex) : hitPoint.material.refractiveIndex;
-				float cosTheta = min(dot(-rayDirection, hitPoint.normal), 1.0);
-				float sinTheta = sqrt(1.0 - cosTheta * cosTheta);
-
-				if (refractionRatio * sinTheta > 1.0 || reflectance(cosTheta, refractionRatio) > u_schlickPass) {
-					rayDirection = reflect(rayDirection, hitPoint.normal);
-				}
-				else {
-					rayDirection = refract(rayDirection, hitPoint.normal, refractionRatio);
-				}
-				rayOrigin = hitPoint.position + rayDirection * EPSILON;
-				energy *= hitPoint.material.albedo;
+			lastPdf = 0.0;
+			int bounceType = chooseBounce(hitPoint, i);
+			if (bounceType == BOUNCE_REFRACT) {
+				refractBounce(hitPoint, rayOrigin, rayDirection, energy);
+			}
+			else if (bounceType == BOUNCE_SPECULAR) {
+				specularBounce(hitPoint, bsdf, get2D(bounceDimension(i, SAMPLER_BSDF)), rayOrigin, rayDirection, energy, lastPdf);
+			}
+			else if (bounceType == BOUNCE_DIFFUSE) {
+				diffuseBounce(hitPoint, bsdf, get2D(bounceDimension(i, SAMPLER_BSDF)), rayOrigin, rayDirection, energy, lastPdf);
 			}
 			else {
-				// reflection
-				float specChance = dot(hitPoint.material.specular, vec3(1.0 / 3.0));
-				float diffChance = dot(hitPoint.material.albedo, vec3(1.0 / 3.0));
-
-				float sum = specChance + diffChance;
-				specChance /= sum;
-				diffChance /= sum;
-
-				float roulette = rand(hitPoint.position.zx + vec2(hitPoint.position.y) + vec2(seed, i));
-				// specular reflections
-				if (roulette < specChance) {
-					float smoothness = 1.0 - hitPoint.material.roughness;
-					float alpha = pow(1000.0, smoothness * smoothness);
-					if (smoothness == 1.0) {
-						rayDirection = reflect(rayDirection, hitPoint.normal);
-					}
-					else {
-						rayDirection = sampleHemisphere(reflect(rayDirection, hitPoint.normal), alpha, hitPoint.position.zx + vec2(hitPoint.position.y) + vec2(seed, i));
-					}
-					rayOrigin = hitPoint.position + rayDirection * EPSILON;
-					float f = (alpha + 2) / (alpha + 1);
-					energy *= hitPoint.material.specular * clamp(dot(hitPoint.normal, rayDirection) * f, 0.0, 1.0);
-				}
-				// diffuse reflections
-				else if (diffChance > 0 && roulette < sum) {
-					rayOrigin = hitPoint.position + hitPoint.normal * EPSILON;
-					rayDirection = sampleHemisphere(hitPoint.normal, 1.0, hitPoint.position.zx + vec2(hitPoint.position.y) + vec2(seed, i));
-					energy *= hitPoint.material.albedo * clamp(dot(hitPoint.normal, rayDirection), 0.0, 1.0);
-				}
-				else {
-					break;
-				}
+				break;
 			}
+
+			if (!russianRoulette(i, energy)) break;
 		}
 		else {
-			// skybox
-			gi += energy * sampleSkybox(rayDirection);
+			// skybox, weighed against the sky samples unless it's the camera ray or came off a mirror or through glass
+			float weight = lastPdf > 0.0 ? powerHeuristic(lastPdf, skyboxPdf(rayDirection)) : 1.0;
+			gi += energy * sampleSkybox(rayDirection) * weight;
 			break;
 		}
 	}
@@ -385,33 +1078,235 @@ vec3 calculateGI(Ray cameraRay, float seed) {
 	return gi; // debug, should be gi
 }
 
-void main() {
-	vec2 centeredUV = (fragUV * 2 - vec2(1)) * vec2(u_aspectRatio, 1.0); // centers the uv so that rays diverge from the center, not a corner and calculates divergence
+// sampler state for one pixel, everything get1D and get2D hash from
+void initSampler(uvec2 pixel) {
+	samplerPixel = pixel;
+	samplerIndex = uint(u_accumulatedPasses);
+	samplerSeedHash = hash(uint(u_seed));
+	samplerPixelHash = hashCombine(hashCombine(samplerSeedHash, samplerPixel.x), samplerPixel.y);
+}
 
-	if (u_directPass) {
-		vec3 rayDir = (normalize(vec4(centeredUV, -1.0, 0.0)) * u_rotationMatrix).xyz;
-		Ray cameraRay = Ray(u_cameraPos, rayDir);
+// camera ray through uv, jittered within the pixel after the first pass. needs initSampler first
+Ray cameraRay(vec2 uv) {
+	vec2 centeredUV = (uv * 2 - vec2(1)) * vec2(u_aspectRatio, 1.0); // centers the uv so that rays diverge from the center, not a corner and calculates divergence
+	float blur = 0.002f;
 
+	if (u_accumulatedPasses > 0) centeredUV += (get2D(SAMPLER_PIXEL_DIMENSION) - vec2(0.5)) * blur;
+	vec3 rayDir = (normalize(vec4(centeredUV, -1.0, 0.0)) * u_rotationMatrix).xyz;
+	return Ray(u_cameraPos, rayDir);
+}
+
+// one path through pixel, shared by the fragment and compute accumulation passes
+vec3 renderSample(uvec2 pixel, vec2 uv) {
+	initSampler(pixel);
+	return calculateGI(cameraRay(uv));
+}
+// --------------------------------------------------
+#shader fragment
+#version 430 core
+
+in vec2 fragUV;
+out vec4 fragColor;
+
+uniform sampler2D u_screenTexture;
+uniform bool u_directPass;
+
+void main() {
+	if (u_directPass) {
 		fragColor = texture(u_screenTexture, fragUV);
-		float passes = float(u_accumulatedPasses);
-		fragColor.x /= passes;
-		fragColor.y /= passes;
-		fragColor.z /= passes;
+		// alpha counts the samples in each pixel, it only differs from u_accumulatedPasses while a tiled compute pass is half done
+		fragColor.xyz /= max(fragColor.w, 1.0);
 	}
 	else {
-		float blur = 0.002f;
-
-		if (u_accumulatedPasses > 0) centeredUV += vec2(rand(vec2(1, u_time) + fragUV.xy) * blur - blur / 2, rand(vec2(2, u_time) + fragUV.xy) * blur - blur / 2);
-		vec3 rayDir = (normalize(vec4(centeredUV, -1.0, 0.0)) * u_rotationMatrix).xyz;
-		Ray cameraRay = Ray(u_cameraPos, rayDir);
-
-		vec3 color = calculateGI(cameraRay, u_time);
+		vec3 color = renderSample(uvec2(gl_FragCoord.xy), fragUV);
 		fragColor = vec4(color, 1.0);
 
+		// u_screenTexture is the other accumulation target here, so reading it while drawing isn't a feedback loop.
+		// texelFetch reads exactly this pixel, filtering at fragUV could blend in a bit of the neighbours
 		if (u_accumulatedPasses > 0) {
-			fragColor += texture(u_screenTexture, fragUV);
+			fragColor += texelFetch(u_screenTexture, ivec2(gl_FragCoord.xy), 0);
 		}
 	}
 }
 // --------------------------------------------------
+#shader compute
+#version 430 core
+// the accumulation pass as a compute shader, computeRenderer dispatches it a tile at a time. u_wavefrontStage 0 runs
+// whole paths like the fragment pass does, the others are calculateGI split into the stages of cpuRenderer's wavefront
+// mode: paths live in u_paths between dispatches and every stage only runs the paths queued for it
+
+layout(local_size_x = 8, local_size_y = 8) in; // COMPUTE_GROUP_SIZE in computeRenderer.h
+layout(rgba32f, binding = 0) uniform image2D u_accumulationImage;
+
+uniform ivec2 u_tileOffset; // first pixel of the tile this dispatch covers
+uniform ivec2 u_tileSize; // pixels in this tile, one path each in wavefront mode
+uniform int u_wavefrontStage;
+uniform int u_bounce; // the bounce the queue stages work on
+
+// same numbers as wavefrontStage in computeRenderer.h
+#define WAVEFRONT_MEGAKERNEL 0
+#define WAVEFRONT_GENERATE 1 // camera rays into the extend queue
+#define WAVEFRONT_EXTEND 2 // closest hit and emission, then queued by what the path does next
+#define WAVEFRONT_MISS 3
+#define WAVEFRONT_SHADOW 4 // direct light
+#define WAVEFRONT_REFRACT 5 // the three bounces and russian roulette, survivors go to the other extend queue
+#define WAVEFRONT_SPECULAR 6
+#define WAVEFRONT_DIFFUSE 7
+#define WAVEFRONT_ACCUMULATE 8
+
+// queues, the two extend ones swap every bounce
+#define QUEUE_MISS 2
+#define QUEUE_SHADOW 3
+#define QUEUE_REFRACT 4
+#define QUEUE_SPECULAR 5
+#define QUEUE_DIFFUSE 6
+
+// the loop variables of calculateGI and the hit the stages after extend shade, see pathState in cpuRenderer.cpp
+struct PathState {
+	vec3 origin;
+	float lastPdf;
+	vec3 direction;
+	uint pixel; // x in the low 16 bits, y in the high ones
+	vec3 energy;
+	int material;
+	vec3 gi;
+	int object;
+	vec3 position;
+	uint frontFace;
+	vec3 normal;
+	float padding;
+};
+
+layout(std430, binding = 11) buffer WavefrontPaths {
+	PathState u_paths[];
+};
+
+// groups is the indirect dispatch that covers count, so a stage launches for exactly the paths queued for it
+struct Queue {
+	uint groupsX;
+	uint groupsY;
+	uint groupsZ;
+	uint count;
+};
+
+layout(std430, binding = 12) buffer WavefrontQueues {
+	Queue u_queues[7];
+	uint u_queueItems[]; // u_tileSize.x * u_tileSize.y per queue
+};
+
+void pushPath(int queue, uint path) {
+	uint slot = atomicAdd(u_queues[queue].count, 1u);
+	u_queueItems[uint(queue * u_tileSize.x * u_tileSize.y) + slot] = path;
+	atomicMax(u_queues[queue].groupsX, slot / 64u + 1u);
+}
+
+SurfacePoint pathHit(PathState path) {
+	return SurfacePoint(path.position, path.normal, path.material, path.object, path.frontFace != 0u);
+}
+
+void setPathHit(inout PathState path, SurfacePoint hitPoint) {
+	path.position = hitPoint.position;
+	path.normal = hitPoint.normal;
+	path.material = hitPoint.material;
+	path.object = hitPoint.object;
+	path.frontFace = hitPoint.frontFace ? 1u : 0u;
+}
+
+// one queued path of the stage, false for the invocations past the end of the queue
+bool queuedPath(int queue, out uint index) {
+	uint item = gl_WorkGroupID.x * 64u + gl_LocalInvocationIndex;
+	if (item >= u_queues[queue].count) return false;
+	index = u_queueItems[uint(queue * u_tileSize.x * u_tileSize.y) + item];
+	return true;
+}
 
+void runStage() {
+	int extendQueue = u_bounce & 1;
+	uint index;
+	if (u_wavefrontStage == WAVEFRONT_EXTEND) {
+		if (!queuedPath(extendQueue, index)) return;
+	}
+	else if (u_wavefrontStage == WAVEFRONT_MISS) {
+		if (!queuedPath(QUEUE_MISS, index)) return;
+	}
+	else if (u_wavefrontStage == WAVEFRONT_SHADOW) {
+		if (!queuedPath(QUEUE_SHADOW, index)) return;
+	}
+	else if (!queuedPath(QUEUE_REFRACT + u_wavefrontStage - WAVEFRONT_REFRACT, index)) {
+		return;
+	}
+
+	PathState path = u_paths[index];
+	initSampler(uvec2(path.pixel & 0xffffu, path.pixel >> 16));
+	if (u_wavefrontStage == WAVEFRONT_EXTEND) {
+		Ray ray = Ray(path.origin, path.direction);
+		SurfacePoint hitPoint;
+		bool hit = raycast(ray, hitPoint);
+		path.gi += path.energy * emissionAlongRay(ray, hit, hitPoint, path.lastPdf);
+		if (hit) {
+			setPathHit(path, hitPoint);
+			path.lastPdf = 0.0;
+			pushPath(QUEUE_SHADOW, index);
+			int bounceType = chooseBounce(hitPoint, u_bounce);
+			if (bounceType != BOUNCE_ABSORB) pushPath(QUEUE_REFRACT + bounceType, index);
+		}
+		else {
+			pushPath(QUEUE_MISS, index);
+		}
+	}
+	else if (u_wavefrontStage == WAVEFRONT_MISS) {
+		float weight = path.lastPdf > 0.0 ? powerHeuristic(path.lastPdf, skyboxPdf(path.direction)) : 1.0;
+		path.gi += path.energy * sampleSkybox(path.direction) * weight;
+	}
+	else {
+		// the bsdf is rebuilt from the hit, the direction is still the one the path arrived along until its bounce runs
+		SurfacePoint hitPoint = pathHit(path);
+		Bsdf bsdf = getBsdf(u_materials[hitPoint.material], hitPoint, path.direction);
+		if (u_wavefrontStage == WAVEFRONT_SHADOW) {
+			path.gi += path.energy * directIllumination(hitPoint, bsdf, path.origin, u_bounce);
+		}
+		else {
+			if (u_wavefrontStage == WAVEFRONT_REFRACT) {
+				refractBounce(hitPoint, path.origin, path.direction, path.energy);
+			}
+			else if (u_wavefrontStage == WAVEFRONT_SPECULAR) {
+				specularBounce(hitPoint, bsdf, get2D(bounceDimension(u_bounce, SAMPLER_BSDF)), path.origin, path.direction, path.energy, path.lastPdf);
+			}
+			else {
+				diffuseBounce(hitPoint, bsdf, get2D(bounceDimension(u_bounce, SAMPLER_BSDF)), path.origin, path.direction, path.energy, path.lastPdf);
+			}
+			if (russianRoulette(u_bounce, path.energy)) pushPath(1 - extendQueue, index);
+		}
+	}
+	u_paths[index] = path;
+}
+
+void main() {
+	if (u_wavefrontStage != WAVEFRONT_MEGAKERNEL && u_wavefrontStage != WAVEFRONT_GENERATE && u_wavefrontStage != WAVEFRONT_ACCUMULATE) {
+		runStage();
+		return;
+	}
+
+	ivec2 size = imageSize(u_accumulationImage);
+	ivec2 local = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 pixel = u_tileOffset + local;
+	if (pixel.x >= size.x || pixel.y >= size.y) return;
+	// same pixel center and uv the fragment pass gets, so both paths draw the same samples
+	vec2 uv = (vec2(pixel) + 0.5) / vec2(size);
+	uint index = uint(local.y * u_tileSize.x + local.x);
+
+	if (u_wavefrontStage == WAVEFRONT_GENERATE) {
+		initSampler(uvec2(pixel));
+		Ray ray = cameraRay(uv);
+		u_paths[index] = PathState(ray.origin, 0.0, ray.direction, uint(pixel.x) | (uint(pixel.y) << 16), vec3(1), 0, vec3(0), 0, vec3(0), 0u, vec3(0), 0.0);
+		pushPath(0, index);
+		return;
+	}
+
+	vec4 color = vec4(u_wavefrontStage == WAVEFRONT_ACCUMULATE ? u_paths[index].gi : renderSample(uvec2(pixel), uv), 1.0);
+	if (u_accumulatedPasses > 0) {
+		color += imageLoad(u_accumulationImage, pixel);
+	}
+	imageStore(u_accumulationImage, pixel, color);
+}
+// --------------------------------------------------
@@ -0,0 +1,113 @@
+// samplers, every value is a function of (pixel, sample index, dimension), mirrored in src/cpu/sampler.cpp
+// pulled into raytrace.shader's common section with #include, so it sees the uniforms declared there
+#define SAMPLER_RANDOM 0
+#define SAMPLER_SOBOL 1
+#define SAMPLER_BLUE_NOISE 2
+#define BLUE_NOISE_SIZE 64
+
+// dimension layout, bounce n starts at 1 + n * SAMPLER_BOUNCE_DIMENSIONS
+#define SAMPLER_PIXEL_DIMENSION 0u
+#define SAMPLER_BOUNCE_DIMENSIONS 5u
+#define SAMPLER_BOUNCE_TYPE 0u
+#define SAMPLER_BSDF 1u
+#define SAMPLER_RUSSIAN_ROULETTE 2u
+#define SAMPLER_SKYBOX 3u // picks the cell, + 1 for the point in it
+// light samples and reservoir candidates go in a range of their own past every bounce block, it holds as many lights,
+// samples or candidates as there are (up to 65536 dimensions per bounce), see lightDimension
+#define SAMPLER_LIGHT_DIMENSIONS 0x80000000u
+
+// set by initSampler in raytrace.shader, once per path
+uvec2 samplerPixel;
+uint samplerIndex;
+uint samplerSeedHash;
+uint samplerPixelHash; // seed and pixel hashed together, every dimension starts from it
+
+// pcg output permutation used as a plain integer hash (Jarzynski and Olano, "Hash Functions for GPU Rendering"), same as src/rng.h
+uint hash(uint x) {
+	uint state = x * 747796405u + 2891336453u;
+	uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+	return (word >> 22u) ^ word;
+}
+
+uint hashCombine(uint seed, uint v) {
+	return seed ^ (hash(v) + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+}
+
+// Laine-Karras style hash from Burley's "Practical Hash-based Owen Scrambling"
+uint laineKarrasPermutation(uint x, uint seed) {
+	x += seed;
+	x ^= x * 0x6c50b47cu;
+	x ^= x * 0xb82f1e52u;
+	x ^= x * 0xc7afe638u;
+	x ^= x * 0x8d22f6e6u;
+	return x;
+}
+
+uint nestedUniformScramble(uint x, uint seed) {
+	return bitfieldReverse(laineKarrasPermutation(bitfieldReverse(x), seed));
+}
+
+// second sobol dimension, the first is just the bit reversed index
+uint sobol1(uint index) {
+	uint result = 0u;
+	for (uint v = 1u << 31; index != 0u; index >>= 1, v ^= v >> 1) {
+		if ((index & 1u) != 0u) result ^= v;
+	}
+	return result;
+}
+
+float toFloat(uint x) {
+	return float(x >> 8) / 16777216.0;
+}
+
+// plain pcg hash of (seed, pixel, index, dimension), uncorrelated but not stratified
+vec2 random2D(uint index, uint dimension) {
+	uint h = hashCombine(hashCombine(samplerPixelHash, index), dimension);
+	return vec2(toFloat(h), toFloat(hash(h)));
+}
+
+// owen scrambled sobol (0, 2) sequence, the index gets shuffled per pixel and dimension so every dimension is its own
+// well stratified 2d set without needing hundreds of sobol dimensions
+vec2 sobol2D(uint index, uint dimension) {
+	uint seed = hashCombine(samplerPixelHash, dimension);
+	index = nestedUniformScramble(index, seed);
+	uint x = nestedUniformScramble(bitfieldReverse(index), hashCombine(seed, 0u));
+	uint y = nestedUniformScramble(sobol1(index), hashCombine(seed, 1u));
+	return vec2(toFloat(x), toFloat(y));
+}
+
+// each dimension reads the tile at its own offset, the r2 sequence then moves every pixel along from sample to sample
+vec2 blueNoise2D(uint index, uint dimension) {
+	// offsets only depend on the seed, not the pixel, or the tile's structure would get scrambled away
+	uint offsetX = hashCombine(samplerSeedHash, dimension);
+	uvec2 offset = uvec2(offsetX, hash(offsetX));
+	vec2 noise = vec2(texelFetch(u_blueNoiseTexture, ivec2((samplerPixel + offset) % uint(BLUE_NOISE_SIZE)), 0).r,
+		texelFetch(u_blueNoiseTexture, ivec2((samplerPixel + offset.yx) % uint(BLUE_NOISE_SIZE)), 0).r);
+	return fract(noise + float(index) * vec2(0.7548776662, 0.5698402910));
+}
+
+// 1d dimensions just use the first half of a 2d one
+vec2 sample2D(uint index, uint dimension) {
+	if (u_samplerType == SAMPLER_SOBOL) return sobol2D(index, dimension);
+	if (u_samplerType == SAMPLER_BLUE_NOISE) return blueNoise2D(index, dimension);
+	return random2D(index, dimension);
+}
+
+vec2 get2D(uint dimension) {
+	return sample2D(samplerIndex, dimension);
+}
+
+float get1D(uint dimension) {
+	return sample2D(samplerIndex, dimension).x;
+}
+
+uint bounceDimension(int bounce, uint offset) {
+	return 1u + uint(bounce) * SAMPLER_BOUNCE_DIMENSIONS + offset;
+}
+
+// light index (emitters after the lights), or with u_lightSamples 2 * sample to pick one and + 1 for the direction to it.
+// resampleLights lays its candidates out like the samples, it replaces them at the first hit so they never meet.
+// none of the samplers care how big a dimension number is, sobol and blue noise hash it like every other one
+uint lightDimension(int bounce, uint offset) {
+	return SAMPLER_LIGHT_DIMENSIONS | (uint(bounce) << 16) | offset;
+}
@@ -0,0 +1,46 @@
+#include "aliasTable.h"
+
+#include <algorithm>
+
+aliasTable::aliasTable() : m_totalWeight(0.0f) {
+
+}
+
+void aliasTable::build(const std::vector<float>& weights) {
+	m_entries.clear();
+	double total = 0.0;
+	for (float w : weights) total += std::max(w, 0.0f);
+	m_totalWeight = (float)total;
+	if (total <= 0.0) return;
+
+	// every bucket holds an average weight of 1, the ones under it get topped up by one that's over
+	unsigned int n = (unsigned int)weights.size();
+	std::vector<double> scaled(n);
+	std::vector<unsigned int> small, large;
+	m_entries.resize(n);
+	for (unsigned int i = 0; i < n; i++) {
+		double weight = std::max(weights[i], 0.0f);
+		scaled[i] = weight * n / total;
+		m_entries[i] = { 1.0f, (int)i, (float)(weight / total), 0.0f };
+		(scaled[i] < 1.0 ? small : large).push_back(i);
+	}
+
+	while (!small.empty() && !large.empty()) {
+		unsigned int under = small.back();
+		unsigned int over = large.back();
+		small.pop_back();
+		large.pop_back();
+
+		m_entries[under].probability = (float)scaled[under];
+		m_entries[under].alias = (int)over;
+		scaled[over] = (scaled[over] + scaled[under]) - 1.0;
+		(scaled[over] < 1.0 ? small : large).push_back(over);
+	}
+	// whatever is left is 1 up to rounding, those keep their own bucket (probability 1 and alias themselves)
+}
+
+int aliasTable::sample(float u, float v) const {
+	int n = (int)m_entries.size();
+	int bucket = std::min((int)(u * n), n - 1);
+	return v < m_entries[bucket].probability ? bucket : m_entries[bucket].alias;
+}
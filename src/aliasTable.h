@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+// matches struct AliasEntry in raytrace.shader, std430 packs it into 16 bytes
+struct aliasEntry {
+	float probability; // chance of keeping this bucket instead of taking its alias
+	int alias;
+	float pdf; // chance of this index coming out of sample() overall
+	float padding;
+};
+
+// walker's alias method (built with vose's algorithm), picks an index with probability proportional to its weight
+// in constant time no matter how many there are. the same table is sampled on the cpu and uploaded for the shader
+class aliasTable {
+private:
+	std::vector<aliasEntry> m_entries;
+	float m_totalWeight;
+public:
+	aliasTable();
+
+	// negative weights count as 0, if every weight is 0 the table ends up empty
+	void build(const std::vector<float>& weights);
+
+	// u picks the bucket, v decides between it and its alias, both in [0, 1)
+	int sample(float u, float v) const;
+
+	inline float pdf(int index) const { return m_entries[index].pdf; }
+	inline bool empty() const { return m_entries.empty(); }
+	inline unsigned int size() const { return (unsigned int)m_entries.size(); }
+	inline float getTotalWeight() const { return m_totalWeight; }
+	inline const std::vector<aliasEntry>& getEntries() const { return m_entries; }
+};
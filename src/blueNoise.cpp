@@ -0,0 +1,121 @@
+#include "blueNoise.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	const float SIGMA = 1.5f; // width of the energy filter, 1.5 is what the paper recommends
+
+	unsigned int hash(unsigned int x) {
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+}
+
+blueNoise::blueNoise(int size, unsigned int seed) : m_size(0) {
+	generate(size, seed);
+}
+
+// the pattern is toroidal so the energy of a pixel only depends on the offset, wrapped into the tile
+void blueNoise::setPixel(int index, bool value) {
+	m_pattern[index] = value;
+	float sign = value ? 1.0f : -1.0f;
+	int px = index % m_size, py = index / m_size;
+	for (int y = 0; y < m_size; y++) {
+		int dy = (y - py) & (m_size - 1);
+		for (int x = 0; x < m_size; x++) {
+			int dx = (x - px) & (m_size - 1);
+			m_energy[y * m_size + x] += sign * m_gaussian[dy * m_size + dx];
+		}
+	}
+}
+
+// set pixel with the most set neighbours
+int blueNoise::tightestCluster() const {
+	int best = -1;
+	for (int i = 0; i < (int)m_pattern.size(); i++) {
+		if (m_pattern[i] && (best == -1 || m_energy[i] > m_energy[best])) best = i;
+	}
+	return best;
+}
+
+// empty pixel with the fewest set neighbours
+int blueNoise::largestVoid() const {
+	int best = -1;
+	for (int i = 0; i < (int)m_pattern.size(); i++) {
+		if (!m_pattern[i] && (best == -1 || m_energy[i] < m_energy[best])) best = i;
+	}
+	return best;
+}
+
+// size has to be a power of two so sample() can wrap with a mask
+void blueNoise::generate(int size, unsigned int seed) {
+	m_size = size;
+	int count = size * size;
+
+	m_gaussian.assign(count, 0.0f);
+	for (int y = 0; y < size; y++) {
+		for (int x = 0; x < size; x++) {
+			float dx = (float)std::min(x, size - x);
+			float dy = (float)std::min(y, size - y);
+			m_gaussian[y * size + x] = std::exp(-(dx * dx + dy * dy) / (2.0f * SIGMA * SIGMA));
+		}
+	}
+
+	// start from about a tenth of the pixels set at random
+	m_energy.assign(count, 0.0f);
+	m_pattern.assign(count, 0);
+	int ones = 0;
+	for (int i = 0; i < count; i++) {
+		if (hash(i ^ hash(seed)) % 10 == 0) {
+			setPixel(i, true);
+			ones++;
+		}
+	}
+	if (ones == 0) {
+		setPixel(0, true);
+		ones = 1;
+	}
+
+	// move the tightest clusters into the largest voids until that stops changing anything
+	while (true) {
+		int cluster = tightestCluster();
+		setPixel(cluster, false);
+		int gap = largestVoid();
+		setPixel(gap, true);
+		if (gap == cluster) break;
+	}
+	std::vector<unsigned char> prototype = m_pattern;
+	std::vector<float> prototypeEnergy = m_energy;
+
+	m_values.assign(count, 0.0f);
+
+	// phase 1, rank the prototype's pixels by taking out the tightest cluster each time
+	for (int rank = ones - 1; rank >= 0; rank--) {
+		int cluster = tightestCluster();
+		setPixel(cluster, false);
+		m_values[cluster] = (float)rank;
+	}
+
+	// phase 2 and 3, fill the rest of the tile into the largest void each time
+	// (past half full the paper swaps to clusters of empty pixels, which is the same pixel as the largest void)
+	m_pattern = prototype;
+	m_energy = prototypeEnergy;
+	for (int rank = ones; rank < count; rank++) {
+		int gap = largestVoid();
+		setPixel(gap, true);
+		m_values[gap] = (float)rank;
+	}
+
+	for (float& v : m_values) {
+		v = (v + 0.5f) / count;
+	}
+
+	m_gaussian.clear();
+	m_energy.clear();
+	m_pattern.clear();
+}
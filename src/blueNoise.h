@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#define BLUE_NOISE_SIZE 64
+
+// tileable blue noise made with void and cluster (Ulichney 1993), every pixel holds its rank / pixel count
+// so the values are spread evenly over [0, 1) and neighbouring pixels never sit close together in value
+// built once at startup, the gpu gets it as a texture and the cpu renderer reads it directly
+class blueNoise {
+private:
+	std::vector<float> m_values;
+	int m_size;
+
+	std::vector<float> m_gaussian; // energy a set pixel adds at every toroidal offset
+	std::vector<float> m_energy;
+	std::vector<unsigned char> m_pattern;
+
+	void setPixel(int index, bool value);
+	int tightestCluster() const;
+	int largestVoid() const;
+public:
+	blueNoise(int size = BLUE_NOISE_SIZE, unsigned int seed = 1);
+
+	void generate(int size, unsigned int seed);
+
+	inline float sample(int x, int y) const { return m_values[(y & (m_size - 1)) * m_size + (x & (m_size - 1))]; }
+	inline int getSize() const { return m_size; }
+	inline const float* getValues() const { return m_values.data(); }
+};
@@ -0,0 +1,166 @@
+#include "bvh.h"
+
+#include <cfloat>
+
+aabb::aabb() : min(FLT_MAX), max(-FLT_MAX) {
+
+}
+
+aabb::aabb(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {
+
+}
+
+void aabb::grow(const aabb& other) {
+	min = glm::min(min, other.min);
+	max = glm::max(max, other.max);
+}
+
+void aabb::grow(const glm::vec3& point) {
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+float aabb::area() const {
+	glm::vec3 extent = max - min;
+	if (extent.x < 0.0f) return 0.0f; // empty
+	return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+bvh::bvh() : m_maxLeafSize(BVH_MAX_LEAF_SIZE) {
+
+}
+
+aabb bvh::objectBounds(const scene::object& o) {
+	glm::vec3 position(o.position[0], o.position[1], o.position[2]);
+	if (o.type == SPHERE) {
+		glm::vec3 radius(std::abs(o.scale[0]));
+		return aabb(position - radius, position + radius);
+	}
+	glm::vec3 halfScale = glm::abs(glm::vec3(o.scale[0], o.scale[1], o.scale[2])) * 0.5f;
+	return aabb(position - halfScale, position + halfScale);
+}
+
+// slab test, entry is clamped to 0 so rays starting inside a box still visit it
+bool bvh::intersectBounds(const bvhNode& node, const glm::vec3& origin, const glm::vec3& invDir, float tMax, float& entry) {
+	glm::vec3 t0 = (glm::vec3(node.min[0], node.min[1], node.min[2]) - origin) * invDir;
+	glm::vec3 t1 = (glm::vec3(node.max[0], node.max[1], node.max[2]) - origin) * invDir;
+	glm::vec3 tsmaller = glm::min(t0, t1);
+	glm::vec3 tbigger = glm::max(t0, t1);
+
+	float tNear = std::max(std::max(tsmaller.x, tsmaller.y), std::max(tsmaller.z, 0.0f));
+	float tFar = std::min(std::min(tbigger.x, tbigger.y), std::min(tbigger.z, tMax));
+	entry = tNear;
+	return tNear <= tFar;
+}
+
+void bvh::clear() {
+	m_nodes.clear();
+	m_indices.clear();
+}
+
+void bvh::build(const std::vector<scene::object>& objects, unsigned int maxLeafSize) {
+	clear();
+	m_maxLeafSize = maxLeafSize;
+
+	m_bounds.resize(objects.size());
+	for (unsigned int i = 0; i < objects.size(); i++) {
+		if (objects[i].type == 0) continue; // object type none never gets hit
+		m_bounds[i] = objectBounds(objects[i]);
+		m_indices.push_back(i);
+	}
+	if (m_indices.empty()) return;
+
+	m_nodes.reserve(m_indices.size() * 2);
+	m_nodes.push_back(bvhNode());
+	subdivide(0, 0, (unsigned int)m_indices.size(), 0);
+}
+
+void bvh::setBounds(bvhNode& node, const aabb& bounds) {
+	for (int i = 0; i < 3; i++) {
+		node.min[i] = bounds.min[i];
+		node.max[i] = bounds.max[i];
+	}
+}
+
+void bvh::subdivide(unsigned int nodeIndex, unsigned int first, unsigned int count, int depth) {
+	aabb bounds, centroidBounds;
+	for (unsigned int i = first; i < first + count; i++) {
+		bounds.grow(m_bounds[m_indices[i]]);
+		centroidBounds.grow(m_bounds[m_indices[i]].centroid());
+	}
+	setBounds(m_nodes[nodeIndex], bounds);
+	m_nodes[nodeIndex].leftFirst = first;
+	m_nodes[nodeIndex].count = count;
+
+	if (count <= 1 || depth >= BVH_MAX_DEPTH - 1) return;
+
+	// bin the centroids along each axis and sweep for the cheapest split
+	int bestAxis = -1;
+	int bestSplit = 0;
+	float bestCost = FLT_MAX;
+	for (int axis = 0; axis < 3; axis++) {
+		float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+		if (extent <= 0.0f) continue;
+
+		aabb binBounds[BVH_BINS];
+		unsigned int binCounts[BVH_BINS] = {};
+		float scale = BVH_BINS / extent;
+		for (unsigned int i = first; i < first + count; i++) {
+			const aabb& b = m_bounds[m_indices[i]];
+			int bin = std::min(BVH_BINS - 1, (int)((b.centroid()[axis] - centroidBounds.min[axis]) * scale));
+			binCounts[bin]++;
+			binBounds[bin].grow(b);
+		}
+
+		float leftArea[BVH_BINS - 1];
+		unsigned int leftCount[BVH_BINS - 1];
+		aabb leftBox;
+		unsigned int leftSum = 0;
+		for (int i = 0; i < BVH_BINS - 1; i++) {
+			leftSum += binCounts[i];
+			leftBox.grow(binBounds[i]);
+			leftCount[i] = leftSum;
+			leftArea[i] = leftBox.area();
+		}
+
+		aabb rightBox;
+		unsigned int rightSum = 0;
+		for (int i = BVH_BINS - 1; i > 0; i--) {
+			rightSum += binCounts[i];
+			rightBox.grow(binBounds[i]);
+			if (leftCount[i - 1] == 0 || rightSum == 0) continue;
+			float cost = leftCount[i - 1] * leftArea[i - 1] + rightSum * rightBox.area();
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+		}
+	}
+
+	// every centroid is in the same spot, nothing to split on
+	if (bestAxis == -1) return;
+
+	// sah: traversal costs about as much as one primitive test, so only split when it pays for itself
+	float area = bounds.area();
+	float splitCost = 1.0f + (area > 0.0f ? bestCost / area : 0.0f);
+	if (splitCost >= (float)count && count <= m_maxLeafSize) return;
+
+	float extent = centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis];
+	float scale = BVH_BINS / extent;
+	auto middle = std::partition(m_indices.begin() + first, m_indices.begin() + first + count, [&](unsigned int index) {
+		int bin = std::min(BVH_BINS - 1, (int)((m_bounds[index].centroid()[bestAxis] - centroidBounds.min[bestAxis]) * scale));
+		return bin < bestSplit;
+	});
+	unsigned int leftCount = (unsigned int)(middle - m_indices.begin()) - first;
+	if (leftCount == 0 || leftCount == count) return;
+
+	unsigned int leftChild = (unsigned int)m_nodes.size();
+	m_nodes.push_back(bvhNode());
+	m_nodes.push_back(bvhNode());
+	m_nodes[nodeIndex].leftFirst = leftChild;
+	m_nodes[nodeIndex].count = 0;
+
+	subdivide(leftChild, first, leftCount, depth + 1);
+	subdivide(leftChild + 1, first + leftCount, count - leftCount, depth + 1);
+}
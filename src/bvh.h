@@ -0,0 +1,119 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "scene.h"
+
+#define BVH_MAX_DEPTH 32
+#define BVH_BINS 12
+#define BVH_MAX_LEAF_SIZE 4
+
+struct aabb {
+	glm::vec3 min;
+	glm::vec3 max;
+
+	aabb();
+	aabb(const glm::vec3& min, const glm::vec3& max);
+
+	void grow(const aabb& other);
+	void grow(const glm::vec3& point);
+	float area() const;
+	inline glm::vec3 centroid() const { return (min + max) * 0.5f; }
+};
+
+// matches struct BVHNode in raytrace.shader (std430: vec3 + int packs into 16 bytes)
+struct bvhNode {
+	float min[3];
+	int leftFirst; // first child for interior nodes (second child is leftFirst + 1), first index for leaves
+	float max[3];
+	int count; // number of objects in a leaf, 0 for interior nodes
+};
+
+// binned sah bvh over scene objects, the same flattened tree is walked on the cpu and uploaded for the shader
+class bvh {
+private:
+	std::vector<bvhNode> m_nodes;
+	std::vector<unsigned int> m_indices; // object indices, leaves reference a contiguous range
+	std::vector<aabb> m_bounds; // per object bounds during a build
+
+	unsigned int m_maxLeafSize;
+
+	void subdivide(unsigned int nodeIndex, unsigned int first, unsigned int count, int depth);
+	void setBounds(bvhNode& node, const aabb& bounds);
+public:
+	bvh();
+
+	void build(const std::vector<scene::object>& objects, unsigned int maxLeafSize = BVH_MAX_LEAF_SIZE);
+	void clear();
+
+	static aabb objectBounds(const scene::object& o);
+	static bool intersectBounds(const bvhNode& node, const glm::vec3& origin, const glm::vec3& invDir, float tMax, float& entry);
+
+	// walks the tree front to back; visitLeaf(first, count, tMax) may shrink tMax and returns true to stop early
+	template<typename leafVisitor>
+	void traverse(const glm::vec3& origin, const glm::vec3& direction, float tMax, leafVisitor visitLeaf) const {
+		if (m_nodes.empty()) return;
+
+		glm::vec3 invDir = 1.0f / direction;
+		float entry;
+		if (!intersectBounds(m_nodes[0], origin, invDir, tMax, entry)) return;
+
+		int stack[BVH_MAX_DEPTH * 2];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0) {
+			const bvhNode& node = m_nodes[stack[--stackSize]];
+			if (node.count > 0) {
+				if (visitLeaf((unsigned int)node.leftFirst, (unsigned int)node.count, tMax)) return;
+				continue;
+			}
+
+			float leftEntry, rightEntry;
+			bool hitLeft = intersectBounds(m_nodes[node.leftFirst], origin, invDir, tMax, leftEntry);
+			bool hitRight = intersectBounds(m_nodes[node.leftFirst + 1], origin, invDir, tMax, rightEntry);
+			// push the far child first so the near one gets popped next
+			if (hitLeft && hitRight) {
+				bool leftFirst = leftEntry <= rightEntry;
+				stack[stackSize++] = leftFirst ? node.leftFirst + 1 : node.leftFirst;
+				stack[stackSize++] = leftFirst ? node.leftFirst : node.leftFirst + 1;
+			}
+			else if (hitLeft) stack[stackSize++] = node.leftFirst;
+			else if (hitRight) stack[stackSize++] = node.leftFirst + 1;
+		}
+	}
+
+	// walks the tree once for a packet of rays, every node gets fetched once for all of them. testNode(node) returns a
+	// bit per ray that enters it, visitLeaf(first, count, mask) gets the rays that reached a leaf and may shrink their
+	// tMax for testNode to see. children are visited near first going by direction, the packet's summed direction
+	template<typename nodeTest, typename leafVisitor>
+	void traversePacket(const glm::vec3& direction, nodeTest testNode, leafVisitor visitLeaf) const {
+		if (m_nodes.empty()) return;
+
+		int stack[BVH_MAX_DEPTH * 2];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+		while (stackSize > 0) {
+			const bvhNode& node = m_nodes[stack[--stackSize]];
+			unsigned int mask = testNode(node);
+			if (mask == 0) continue;
+			if (node.count > 0) {
+				visitLeaf((unsigned int)node.leftFirst, (unsigned int)node.count, mask);
+				continue;
+			}
+
+			// the far child goes on the stack first, far being the one the packet is heading away from
+			const bvhNode& left = m_nodes[node.leftFirst];
+			const bvhNode& right = m_nodes[node.leftFirst + 1];
+			glm::vec3 split(right.min[0] + right.max[0] - left.min[0] - left.max[0], right.min[1] + right.max[1] - left.min[1] - left.max[1], right.min[2] + right.max[2] - left.min[2] - left.max[2]);
+			bool leftFirst = glm::dot(split, direction) >= 0.0f;
+			stack[stackSize++] = leftFirst ? node.leftFirst + 1 : node.leftFirst;
+			stack[stackSize++] = leftFirst ? node.leftFirst : node.leftFirst + 1;
+		}
+	}
+
+	inline const std::vector<bvhNode>& getNodes() const { return m_nodes; }
+	inline const std::vector<unsigned int>& getIndices() const { return m_indices; }
+};
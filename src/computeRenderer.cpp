@@ -0,0 +1,126 @@
+#include "computeRenderer.h"
+
+#include <algorithm>
+
+#include "renderer.h"
+#include "scene.h"
+
+computeRenderer::computeRenderer(shader& computeShader, unsigned int accumulationTexture, int width, int height, int tileSize)
+    : m_shader(computeShader), m_texture(accumulationTexture), m_width(width), m_height(height), m_tileSize(0), m_nextTile(0),
+    m_wavefront(false), m_paths(11), m_queues(12) {
+    m_tileOffsetUniform = m_shader.getUniform("u_tileOffset");
+    m_tileSizeUniform = m_shader.getUniform("u_tileSize");
+    m_stageUniform = m_shader.getUniform("u_wavefrontStage");
+    m_bounceUniform = m_shader.getUniform("u_bounce");
+    setTileSize(tileSize);
+}
+
+// tiles are disjoint, so the only barrier needed is the one between passes
+bool computeRenderer::dispatch(int tileBudget) {
+    int tilesX = (m_width + m_tileSize - 1) / m_tileSize;
+    int tileCount = getTileCount();
+    int lastTile = tileBudget > 0 ? std::min(m_nextTile + tileBudget, tileCount) : tileCount;
+
+    m_shader.bind();
+    call(glBindImageTexture(0, m_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F));
+    m_shader.setUniform1i(m_stageUniform, (int)wavefrontStage::MEGAKERNEL);
+    for (; m_nextTile < lastTile; m_nextTile++) {
+        int x = (m_nextTile % tilesX) * m_tileSize;
+        int y = (m_nextTile / tilesX) * m_tileSize;
+        int width = std::min(m_tileSize, m_width - x);
+        int height = std::min(m_tileSize, m_height - y);
+
+        m_shader.setUniform2i(m_tileOffsetUniform, x, y);
+        m_shader.setUniform2i(m_tileSizeUniform, width, height);
+        if (m_wavefront) {
+            dispatchWavefront(width, height);
+        }
+        else {
+            call(glDispatchCompute((width + COMPUTE_GROUP_SIZE - 1) / COMPUTE_GROUP_SIZE, (height + COMPUTE_GROUP_SIZE - 1) / COMPUTE_GROUP_SIZE, 1));
+        }
+        // its own submission, the driver sees lots of short jobs instead of one long one
+        call(glFlush());
+    }
+
+    // the next pass imageLoads these pixels and reads the reservoirs, the display pass samples them as a texture
+    call(glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT));
+
+    if (m_nextTile < tileCount) return false;
+    m_nextTile = 0;
+    return true;
+}
+
+// calculateGI a stage at a time, in the same order renderTileWavefront runs them. the host doesn't know when every
+// path has ended without reading the queues back, so it goes through all the bounces and the empty ones launch nothing
+void computeRenderer::dispatchWavefront(int width, int height) {
+    // every queue can hold every path of the tile
+    unsigned int pathCount = (unsigned int)(width * height);
+    unsigned int headerSize = WAVEFRONT_QUEUES * 4 * sizeof(unsigned int);
+    m_paths.allocate(pathCount * WAVEFRONT_PATH_SIZE);
+    m_queues.allocate(headerSize + WAVEFRONT_QUEUES * pathCount * sizeof(unsigned int));
+    const unsigned int emptyQueue[4] = { 0, 1, 1, 0 }; // no groups, count 0
+
+    // the last tile's stages may still be using the paths and queues
+    call(glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT));
+    m_queues.clear(0, headerSize, emptyQueue);
+    m_shader.setUniform1i(m_bounceUniform, 0);
+    m_shader.setUniform1i(m_stageUniform, (int)wavefrontStage::GENERATE);
+    call(glDispatchCompute((width + COMPUTE_GROUP_SIZE - 1) / COMPUTE_GROUP_SIZE, (height + COMPUTE_GROUP_SIZE - 1) / COMPUTE_GROUP_SIZE, 1));
+
+    for (int bounce = 0; bounce < scene::lightBounces; bounce++) {
+        int extendQueue = bounce & 1;
+        // everything but the extend queue this bounce reads starts out empty
+        call(glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT));
+        m_queues.clear((1 - extendQueue) * sizeof(emptyQueue), sizeof(emptyQueue), emptyQueue);
+        m_queues.clear(2 * sizeof(emptyQueue), (WAVEFRONT_QUEUES - 2) * sizeof(emptyQueue), emptyQueue);
+        m_shader.setUniform1i(m_bounceUniform, bounce);
+
+        // each stage's queue headers double as its indirect dispatch arguments, written by the stage before
+        call(glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT));
+        dispatchQueue(wavefrontStage::EXTEND, extendQueue);
+        call(glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT));
+        // miss and shadow work on different paths, so they can overlap
+        dispatchQueue(wavefrontStage::MISS, 2);
+        dispatchQueue(wavefrontStage::SHADOW, 3);
+        // the bounces move the paths on, so shadow has to be done with their origins first
+        call(glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT));
+        dispatchQueue(wavefrontStage::REFRACT, 4);
+        dispatchQueue(wavefrontStage::SPECULAR, 5);
+        dispatchQueue(wavefrontStage::DIFFUSE, 6);
+    }
+
+    call(glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT));
+    m_shader.setUniform1i(m_stageUniform, (int)wavefrontStage::ACCUMULATE);
+    call(glDispatchCompute((width + COMPUTE_GROUP_SIZE - 1) / COMPUTE_GROUP_SIZE, (height + COMPUTE_GROUP_SIZE - 1) / COMPUTE_GROUP_SIZE, 1));
+    m_shader.setUniform1i(m_stageUniform, (int)wavefrontStage::MEGAKERNEL);
+}
+
+// one stage over a queue, as many groups as the stages before it left in the queue's header
+void computeRenderer::dispatchQueue(wavefrontStage stage, int queue) {
+    m_shader.setUniform1i(m_stageUniform, (int)stage);
+    call(glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, m_queues.getID()));
+    call(glDispatchComputeIndirect(queue * 4 * sizeof(unsigned int)));
+}
+
+void computeRenderer::setTarget(unsigned int accumulationTexture) {
+    m_texture = accumulationTexture;
+}
+
+void computeRenderer::setWavefront(bool enabled) {
+    m_wavefront = enabled;
+}
+
+void computeRenderer::restart() {
+    m_nextTile = 0;
+}
+
+// rounded up to whole work groups, changing it starts the pass over
+void computeRenderer::setTileSize(int tileSize) {
+    tileSize = std::max(tileSize, COMPUTE_GROUP_SIZE);
+    m_tileSize = (tileSize + COMPUTE_GROUP_SIZE - 1) / COMPUTE_GROUP_SIZE * COMPUTE_GROUP_SIZE;
+    m_nextTile = 0;
+}
+
+int computeRenderer::getTileCount() const {
+    return ((m_width + m_tileSize - 1) / m_tileSize) * ((m_height + m_tileSize - 1) / m_tileSize);
+}
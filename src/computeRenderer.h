@@ -0,0 +1,55 @@
+#pragma once
+
+#include "glabstraction/shader.h"
+#include "glabstraction/storageBuffer.h"
+
+#define COMPUTE_GROUP_SIZE 8 // local_size_x and local_size_y of the compute stage in raytrace.shader
+#define WAVEFRONT_QUEUES 7 // two extend queues, then miss, shadow, refract, specular and diffuse
+#define WAVEFRONT_PATH_SIZE 96 // std430 size of PathState in raytrace.shader
+
+// u_wavefrontStage, what one dispatch of the compute stage does. the same numbers are #defined in raytrace.shader
+enum class wavefrontStage {
+	MEGAKERNEL = 0, // whole paths, one invocation per pixel
+	GENERATE = 1,
+	EXTEND = 2,
+	MISS = 3,
+	SHADOW = 4,
+	REFRACT = 5,
+	SPECULAR = 6,
+	DIFFUSE = 7,
+	ACCUMULATE = 8
+};
+
+// runs the accumulation pass through the compute stage of raytrace.shader, which imageStores straight into the
+// accumulation texture. every tile is its own dispatch so none of them runs long enough to trip the driver timeout,
+// and with a tile budget one pass gets spread over several frames.
+// in wavefront mode a tile is a pool of paths instead, advanced a stage at a time like cpuRenderer's wavefront mode.
+// the stages queue paths for each other on the gpu and dispatch indirectly off those queues, so nothing is read back
+class computeRenderer {
+private:
+	shader& m_shader;
+	unsigned int m_texture;
+	int m_width, m_height;
+	int m_tileSize;
+	int m_nextTile; // first tile of the current pass that hasn't been dispatched
+	bool m_wavefront;
+	storageBuffer m_paths; // binding 11, one path per pixel of a tile
+	storageBuffer m_queues; // binding 12, the queue headers (indirect dispatch arguments and counts) then their items
+	uniformHandle m_tileOffsetUniform, m_tileSizeUniform, m_stageUniform, m_bounceUniform;
+
+	void dispatchWavefront(int width, int height); // the tile offset is already in u_tileOffset
+	void dispatchQueue(wavefrontStage stage, int queue);
+public:
+	computeRenderer(shader& computeShader, unsigned int accumulationTexture, int width, int height, int tileSize = 256);
+
+	bool dispatch(int tileBudget); // dispatches up to tileBudget tiles (0 for the rest of the pass), true once the pass is done
+	void restart();
+	void setTarget(unsigned int accumulationTexture); // takes effect at the next dispatch
+	void setTileSize(int tileSize);
+	void setWavefront(bool enabled); // takes effect at the next dispatch
+
+	int getTileCount() const;
+	inline int getTileSize() const { return m_tileSize; }
+	inline int getNextTile() const { return m_nextTile; }
+	inline bool isWavefront() const { return m_wavefront; }
+};
@@ -0,0 +1,1144 @@
+#include "cpuRenderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include <glm/gtc/packing.hpp>
+
+#include "hdrImage.h"
+#include "sampler.h"
+#include "simdKernels.h"
+#include "../aliasTable.h"
+#include "../bvh.h"
+#include "../rng.h"
+#include "../scene.h"
+#include "../skyboxDistribution.h"
+
+// everything in here mirrors res/shaders/raytrace.shader function for function, keep them in sync
+namespace {
+	const float RENDER_DISTANCE = 10000.0f;
+	const float EPSILON = 0.0001f;
+	const float PI = 3.1415926538f;
+	const int RAY_BIN_RESOLUTION = 32; // cells per axis when binning secondary rays, keys use 5 bits per axis
+	const int RESERVOIR_NEIGHBOURS = 3;
+	const float RESERVOIR_RADIUS = 0.03f; // of the screen height
+	const int RESERVOIR_HISTORY = 2;
+	const int RESERVOIR_REUSE_PASSES = 8;
+
+	struct ray {
+		glm::vec3 origin;
+		glm::vec3 direction;
+	};
+
+	struct surfacePoint {
+		glm::vec3 position;
+		glm::vec3 normal;
+		const scene::material* material;
+		int object; // index into scene::objects, -1 for the plane
+
+		bool frontFace;
+	};
+
+	// the scene properties a pass needs, copied once so the workers never touch the gui state
+	struct passState {
+		const hdrImage* skybox;
+		const skyboxDistribution* skyboxTable;
+		const bvh* objectBVH;
+		const objectSoA* objects;
+		float schlickPass;
+		int shadowRays;
+		int lightSamples;
+		int reservoirCandidates;
+		scene::gpuReservoir* reservoirs; // both halves, width * height each
+		int width, height;
+		const aliasTable* lightTable;
+		const std::vector<int>* emitters;
+		const bvh* lightBVH;
+		int lightBounces;
+		int rouletteDepth;
+		samplerType sampling;
+		const blueNoise* noise;
+		int sampleIndex;
+		unsigned int seed;
+		float skyboxGamma;
+		float skyboxStrength;
+		bool planeVisible;
+		const scene::material* planeMaterial;
+	};
+
+	inline glm::vec3 toVec3(const float* f) {
+		return glm::vec3(f[0], f[1], f[2]);
+	}
+
+	bool sphereIntersection(glm::vec3 position, float radius, const ray& r, float& hitDistance) {
+		glm::vec3 relativeOrigin = r.origin - position;
+
+		float a = glm::dot(r.direction, r.direction);
+		float half_b = glm::dot(relativeOrigin, r.direction);
+		float c = glm::dot(relativeOrigin, relativeOrigin) - radius * radius;
+
+		float discriminant = half_b * half_b - a * c;
+		if (discriminant < 0) {
+			return false;
+		}
+		float sqrtd = std::sqrt(discriminant);
+		float root = (-half_b - sqrtd) / a;
+		if (root < 0) {
+			root = (-half_b + sqrtd) / a;
+			if (root < 0)
+				return false;
+		}
+		hitDistance = root;
+		return true;
+	}
+
+	bool boxIntersection(glm::vec3 position, glm::vec3 scale, const ray& r, float& hitDistance) {
+		float t1 = -1000000000000.0f;
+		float t2 = 1000000000000.0f;
+
+		glm::vec3 boxMin = position - scale / 2.0f;
+		glm::vec3 boxMax = position + scale / 2.0f;
+
+		glm::vec3 t0s = (boxMin - r.origin) / r.direction;
+		glm::vec3 t1s = (boxMax - r.origin) / r.direction;
+
+		glm::vec3 tsmaller = glm::min(t0s, t1s);
+		glm::vec3 tbigger = glm::max(t0s, t1s);
+
+		t1 = std::max(t1, std::max(tsmaller.x, std::max(tsmaller.y, tsmaller.z)));
+		t2 = std::min(t2, std::min(tbigger.x, std::min(tbigger.y, tbigger.z)));
+
+		hitDistance = t1;
+		if (t1 < 0) hitDistance = t2;
+		return ((t1 >= 0 || t2 >= 0) && t1 <= t2);
+	}
+
+	glm::vec3 boxNormal(glm::vec3 cubePosition, glm::vec3 scale, glm::vec3 surfacePosition) {
+		glm::vec3 boxMin = cubePosition - scale / 2.0f;
+		glm::vec3 boxMax = cubePosition + scale / 2.0f;
+
+		glm::vec3 center = (boxMax + boxMin) * 0.5f;
+		glm::vec3 boxSize = (boxMax - boxMin) * 0.5f;
+		glm::vec3 pc = surfacePosition - center;
+		glm::vec3 normal(0.0f);
+		normal += glm::vec3(glm::sign(pc.x), 0.0f, 0.0f) * glm::step(std::abs(std::abs(pc.x) - boxSize.x), EPSILON);
+		normal += glm::vec3(0.0f, glm::sign(pc.y), 0.0f) * glm::step(std::abs(std::abs(pc.y) - boxSize.y), EPSILON);
+		normal += glm::vec3(0.0f, 0.0f, glm::sign(pc.z)) * glm::step(std::abs(std::abs(pc.z) - boxSize.z), EPSILON);
+		return glm::normalize(normal);
+	}
+
+	bool planeIntersection(glm::vec3 planeNormal, glm::vec3 planePoint, const ray& r, float& hitDistance) {
+		float angle = glm::dot(planeNormal, r.direction);
+		if (std::abs(angle) > EPSILON) {
+			glm::vec3 distance = planePoint - r.origin;
+			hitDistance = glm::dot(distance, planeNormal) / angle;
+			return (hitDistance >= EPSILON);
+		}
+		return false;
+	}
+
+	// the plane, then the normal and material of whichever hit is closest. only that one gets them built
+	bool finishHit(const passState& state, const ray& r, float minHitDist, int hitObject, surfacePoint& hitPoint) {
+		float hitDist;
+		bool hitPlane = false;
+
+		if (state.planeVisible && planeIntersection(glm::vec3(0, 1, 0), glm::vec3(0, 0, 0), r, hitDist) && hitDist < minHitDist) {
+			minHitDist = hitDist;
+			hitPlane = true;
+		}
+
+		hitPoint.position = r.origin + r.direction * minHitDist;
+		if (hitPlane) {
+			hitPoint.normal = glm::vec3(0, 1, 0);
+			hitPoint.frontFace = true;
+			hitPoint.material = state.planeMaterial;
+			hitPoint.object = -1;
+		}
+		else if (hitObject >= 0) {
+			const scene::object& o = scene::objects[hitObject];
+			glm::vec3 position = toVec3(o.position);
+			glm::vec3 outwardNormal = o.type == SPHERE ? glm::normalize(hitPoint.position - position) : boxNormal(position, toVec3(o.scale), hitPoint.position);
+			hitPoint.frontFace = glm::dot(r.direction, outwardNormal) < 0;
+			hitPoint.normal = hitPoint.frontFace ? outwardNormal : -outwardNormal;
+			hitPoint.material = &scene::materials[o.mat];
+			hitPoint.object = hitObject;
+		}
+
+		return hitPlane || hitObject >= 0;
+	}
+
+	bool raycast(const passState& state, const ray& r, surfacePoint& hitPoint) {
+		float minHitDist = RENDER_DISTANCE;
+		int hitObject = -1;
+
+		// the soa is in bvh index order so every leaf is one run of simd lanes
+		state.objectBVH->traverse(r.origin, r.direction, minHitDist, [&](unsigned int first, unsigned int count, float& tMax) {
+			int lane = simd::closestHit(*state.objects, first, count, r.origin, r.direction, tMax);
+			if (lane >= 0) {
+				minHitDist = tMax;
+				hitObject = (int)state.objects->getObjectIndex(lane);
+			}
+			return false;
+		});
+
+		return finishHit(state, r, minHitDist, hitObject, hitPoint);
+	}
+
+	// raycast for up to SIMD_PACKET_SIZE rays that go through the bvh together, every node is tested against all of
+	// them at once. the hits are the same as tracing them one at a time
+	void raycastPacket(const passState& state, const ray* rays, unsigned int rayCount, surfacePoint* hitPoints, bool* hits) {
+		simd::rayPacket packet;
+		int hitObject[SIMD_PACKET_SIZE];
+		glm::vec3 direction(0.0f);
+		for (unsigned int i = 0; i < SIMD_PACKET_SIZE; i++) {
+			glm::vec3 origin = i < rayCount ? rays[i].origin : glm::vec3(0.0f);
+			glm::vec3 invDir = i < rayCount ? 1.0f / rays[i].direction : glm::vec3(1.0f);
+			packet.ox[i] = origin.x;
+			packet.oy[i] = origin.y;
+			packet.oz[i] = origin.z;
+			packet.ix[i] = invDir.x;
+			packet.iy[i] = invDir.y;
+			packet.iz[i] = invDir.z;
+			packet.tMax[i] = i < rayCount ? RENDER_DISTANCE : -1.0f;
+			hitObject[i] = -1;
+			if (i < rayCount) direction += rays[i].direction;
+		}
+
+		state.objectBVH->traversePacket(direction, [&](const bvhNode& node) {
+			return simd::packetBounds(node.min, node.max, packet);
+		}, [&](unsigned int first, unsigned int count, unsigned int mask) {
+			for (unsigned int i = 0; i < rayCount; i++) {
+				if (!(mask & (1u << i))) continue;
+				int lane = simd::closestHit(*state.objects, first, count, rays[i].origin, rays[i].direction, packet.tMax[i]);
+				if (lane >= 0) hitObject[i] = (int)state.objects->getObjectIndex(lane);
+			}
+		});
+
+		for (unsigned int i = 0; i < rayCount; i++) {
+			hits[i] = finishHit(state, rays[i], packet.tMax[i], hitObject[i], hitPoints[i]);
+		}
+	}
+
+	// shadow rays only need to know if anything is in the way, so stop at the first blocker nearer than maxDistance
+	bool occluded(const passState& state, const ray& r, float maxDistance) {
+		maxDistance = std::min(maxDistance, RENDER_DISTANCE);
+
+		float hitDist;
+		if (state.planeVisible && planeIntersection(glm::vec3(0, 1, 0), glm::vec3(0, 0, 0), r, hitDist) && hitDist < maxDistance)
+			return true;
+
+		bool blocked = false;
+		state.objectBVH->traverse(r.origin, r.direction, maxDistance, [&](unsigned int first, unsigned int count, float& tMax) {
+			blocked = simd::anyHit(*state.objects, first, count, r.origin, r.direction, tMax);
+			return blocked;
+		});
+		return blocked;
+	}
+
+	glm::mat3 getTangentSpace(glm::vec3 normal) {
+		glm::vec3 helper(1, 0, 0);
+		if (std::abs(normal.x) > 0.99f)
+			helper = glm::vec3(0, 0, 1);
+
+		glm::vec3 tangent = glm::normalize(glm::cross(normal, helper));
+		glm::vec3 binormal = glm::normalize(glm::cross(normal, tangent));
+		return glm::mat3(tangent, binormal, normal);
+	}
+
+	glm::vec3 sampleHemisphere(glm::vec3 normal, float alpha, glm::vec2 u) {
+		float cosTheta = std::pow(u.x, 1.0f / (alpha + 1.0f));
+		float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+		float phi = 2 * PI * u.y;
+		glm::vec3 tangentSpaceDir(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
+
+		return getTangentSpace(normal) * tangentSpaceDir;
+	}
+
+	glm::vec3 sampleSkybox(const passState& state, glm::vec3 dir) {
+		if (state.skyboxStrength == 0.0f || !state.skybox) return glm::vec3(0.0f);
+		glm::vec3 color = state.skybox->sample(0.5f + std::atan2(dir.x, dir.z) / (2 * PI), 0.5f + std::asin(glm::clamp(dir.y, -1.0f, 1.0f)) / PI);
+		return state.skyboxStrength * glm::pow(glm::max(color, glm::vec3(0.0f)), glm::vec3(1 / state.skyboxGamma));
+	}
+
+	glm::vec3 refract(glm::vec3 rayDir, glm::vec3 surfaceNormal, float etaOverEtaPrime) {
+		float cosTheta = std::min(glm::dot(-rayDir, surfaceNormal), 1.0f);
+		glm::vec3 Rperp = etaOverEtaPrime * (rayDir + cosTheta * surfaceNormal);
+		// Rperp.length() in the shader is the component count (3), not the magnitude, so this matches it on purpose
+		float length = (float)Rperp.length();
+		glm::vec3 Rpara = -std::sqrt(std::abs(1 - length * length)) * surfaceNormal;
+		return glm::normalize(Rperp + Rpara);
+	}
+
+	float reflectance(float cosine, float ref_idx) {
+		// Schlick's approximation
+		float r0 = (1 - ref_idx) / (1 + ref_idx);
+		r0 = r0 * r0;
+		return r0 + (1 - r0) * std::pow((1 - cosine), 5.0f);
+	}
+
+	// the scattering at a hit as both light sampling and the bounce see it, see Bsdf in raytrace.shader
+	struct bsdf {
+		glm::vec3 normal;
+		glm::vec3 reflected;
+		glm::vec3 albedo;
+		glm::vec3 specular;
+		float alpha;
+		float diffuseWeight;
+		float diffuseChance;
+		float glossyChance;
+	};
+
+	bsdf getBsdf(const surfacePoint& hitPoint, glm::vec3 rayDirection) {
+		const scene::material& material = *hitPoint.material;
+		bsdf b;
+		b.normal = hitPoint.normal;
+		b.reflected = glm::reflect(rayDirection, hitPoint.normal);
+		b.albedo = toVec3(material.albedo);
+		b.specular = toVec3(material.specular);
+		float smoothness = 1.0f - material.roughness;
+		b.alpha = std::pow(1000.0f, smoothness * smoothness);
+		if (material.transparent) {
+			b.diffuseWeight = 1.0f;
+			b.diffuseChance = 0.0f;
+			b.glossyChance = 0.0f;
+			return b;
+		}
+
+		float specChance = glm::dot(b.specular, glm::vec3(1.0f / 3.0f));
+		float diffChance = glm::dot(b.albedo, glm::vec3(1.0f / 3.0f));
+		float sum = specChance + diffChance;
+		b.diffuseChance = sum > 0.0f ? diffChance / sum : 0.0f;
+		b.diffuseWeight = b.diffuseChance;
+		b.glossyChance = sum > 0.0f && smoothness < 1.0f ? specChance / sum : 0.0f;
+		return b;
+	}
+
+	glm::vec3 evalBsdf(const bsdf& b, glm::vec3 dir) {
+		float cosTheta = glm::dot(b.normal, dir);
+		if (cosTheta <= 0.0f) return glm::vec3(0.0f);
+		glm::vec3 f = b.diffuseWeight * b.albedo / PI;
+		if (b.glossyChance > 0.0f) f += b.glossyChance * b.specular * (b.alpha + 2.0f) / (2.0f * PI) * std::pow(std::max(glm::dot(b.reflected, dir), 0.0f), b.alpha);
+		return f * cosTheta;
+	}
+
+	float bsdfPdf(const bsdf& b, glm::vec3 dir) {
+		float pdf = b.diffuseChance * std::max(glm::dot(b.normal, dir), 0.0f) / PI;
+		if (b.glossyChance > 0.0f) pdf += b.glossyChance * (b.alpha + 1.0f) / (2.0f * PI) * std::pow(std::max(glm::dot(b.reflected, dir), 0.0f), b.alpha);
+		return pdf;
+	}
+
+	float powerHeuristic(float a, float b) {
+		if (a <= 0.0f) return 0.0f;
+		return a * a / (a * a + b * b);
+	}
+
+	float skyboxPdf(const passState& state, glm::vec3 dir) {
+		if (state.skyboxStrength == 0.0f) return 0.0f;
+		return state.skyboxTable->pdf(dir);
+	}
+
+	// one shadow ray towards a cell of the sky picked by brightness, transparent materials and perfect mirrors only see it through their bounce
+	glm::vec3 sampleSkyboxLight(const passState& state, const surfacePoint& hitPoint, const bsdf& b, const sampler& s, int bounce) {
+		if (state.skyboxStrength == 0.0f || state.skyboxTable->empty() || b.diffuseChance + b.glossyChance <= 0.0f) return glm::vec3(0.0f);
+
+		float pdf;
+		glm::vec3 direction = state.skyboxTable->sample(s.get2D(bounceDimension(bounce, SAMPLER_SKYBOX)), s.get2D(bounceDimension(bounce, SAMPLER_SKYBOX + 1)), pdf);
+		if (pdf <= 0.0f) return glm::vec3(0.0f);
+
+		glm::vec3 f = evalBsdf(b, direction);
+		if (f == glm::vec3(0.0f)) return f;
+		if (occluded(state, { hitPoint.position + direction * EPSILON * 2.0f, direction }, RENDER_DISTANCE)) return glm::vec3(0.0f);
+		return f * sampleSkybox(state, direction) * powerHeuristic(pdf, bsdfPdf(b, direction)) / pdf;
+	}
+
+	float sampleSphereCone(glm::vec3 center, float radius, glm::vec3 position, glm::vec2 u, glm::vec3& direction, float& surfaceDistance) {
+		glm::vec3 toCenter = center - position;
+		float centerDistance = glm::length(toCenter);
+		float sinThetaMax2 = std::min(radius * radius / (centerDistance * centerDistance), 1.0f);
+		float cosThetaMax = std::sqrt(1.0f - sinThetaMax2);
+		float oneMinusCosThetaMax = sinThetaMax2 / (1.0f + cosThetaMax);
+		float cosTheta = 1.0f - u.x * oneMinusCosThetaMax;
+		float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+		float phi = 2 * PI * u.y;
+		direction = getTangentSpace(toCenter / centerDistance) * glm::vec3(std::cos(phi) * sinTheta, std::sin(phi) * sinTheta, cosTheta);
+
+		float halfChord = std::sqrt(std::max(radius * radius - centerDistance * centerDistance * sinTheta * sinTheta, 0.0f));
+		surfaceDistance = centerDistance * cosTheta - halfChord;
+		if (surfaceDistance <= 0.0f) surfaceDistance = centerDistance * cosTheta + halfChord;
+		return 1.0f / (2.0f * PI * oneMinusCosThetaMax);
+	}
+
+	float sphereConePdf(glm::vec3 center, float radius, glm::vec3 position) {
+		float centerDistance = glm::length(center - position);
+		float sinThetaMax2 = std::min(radius * radius / (centerDistance * centerDistance), 1.0f);
+		return 1.0f / (2.0f * PI * sinThetaMax2 / (1.0f + std::sqrt(1.0f - sinThetaMax2)));
+	}
+
+	glm::vec3 visibleBoxFaces(glm::vec3 center, glm::vec3 scale, glm::vec3 position) {
+		return glm::vec3(scale.y * scale.z, scale.x * scale.z, scale.x * scale.y) * glm::step(scale / 2.0f, glm::abs(position - center));
+	}
+
+	float sampleBox(glm::vec3 center, glm::vec3 scale, glm::vec3 position, glm::vec2 u, glm::vec3& direction, float& surfaceDistance) {
+		glm::vec3 faces = visibleBoxFaces(center, scale, position);
+		float area = faces.x + faces.y + faces.z;
+		if (area <= 0.0f) return 0.0f;
+
+		float pick = u.x * area;
+		// rounding can push pick past the last face, so a face with no area is never the one picked
+		int axis = faces.z > 0.0f && pick >= faces.x + faces.y ? 2 : (faces.y > 0.0f && pick >= faces.x ? 1 : 0);
+		float start = axis == 0 ? 0.0f : (axis == 1 ? faces.x : faces.x + faces.y);
+		glm::vec2 uv(glm::clamp((pick - start) / faces[axis], 0.0f, 1.0f), u.y);
+
+		glm::vec3 point = center;
+		point[axis] += glm::sign(position[axis] - center[axis]) * scale[axis] / 2.0f;
+		point[(axis + 1) % 3] += (uv.x - 0.5f) * scale[(axis + 1) % 3];
+		point[(axis + 2) % 3] += (uv.y - 0.5f) * scale[(axis + 2) % 3];
+
+		glm::vec3 toPoint = point - position;
+		surfaceDistance = glm::length(toPoint);
+		direction = toPoint / surfaceDistance;
+		float cosLight = std::abs(direction[axis]);
+		if (cosLight <= EPSILON) return 0.0f;
+		return surfaceDistance * surfaceDistance / (area * cosLight);
+	}
+
+	float boxPdf(glm::vec3 center, glm::vec3 scale, glm::vec3 position, glm::vec3 direction, const surfacePoint& hitPoint) {
+		glm::vec3 faces = visibleBoxFaces(center, scale, position);
+		float area = faces.x + faces.y + faces.z;
+		float cosLight = std::abs(glm::dot(direction, hitPoint.normal));
+		if (area <= 0.0f || cosLight <= EPSILON) return 0.0f;
+		float hitDistance = glm::length(hitPoint.position - position);
+		return hitDistance * hitDistance / (area * cosLight);
+	}
+
+	float emitterSamples(const passState& state, int slot) {
+		if (state.lightSamples > 0) return state.lightTable->empty() ? 0.0f : (float)state.lightSamples * state.lightTable->pdf(slot);
+		return (float)std::max(state.shadowRays, 1);
+	}
+
+	// a light sample towards slot at u before any mis weight or sample count, the same as LightSample in the shader
+	struct lightSample {
+		glm::vec3 highlight;
+		glm::vec3 contribution;
+		glm::vec3 direction;
+		float distance;
+		float pdf;
+	};
+
+	// the lights first and then the emissive objects
+	lightSample evalEmitter(const passState& state, int slot, const surfacePoint& hitPoint, const bsdf& b, glm::vec3 cameraPos, glm::vec2 u) {
+		lightSample ls = { glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 0.0f, 0.0f };
+		const int lightCount = (int)scene::lights.size();
+		glm::vec3 radiance;
+		float surfaceDistance;
+		if (slot < lightCount) {
+			const scene::pointLight& light = scene::lights[slot];
+			glm::vec3 lightPosition = toVec3(light.position);
+			glm::vec3 lightColor = toVec3(light.color);
+			glm::vec3 toLight = lightPosition - hitPoint.position;
+			float lightDistance = glm::length(toLight);
+			if (lightDistance > light.reach) return ls;
+
+			// specular highlights, skipped outright without one since a hit right on top of the last could make cameraDir nan
+			float diffuse = glm::clamp(glm::dot(hitPoint.normal, toLight / lightDistance), 0.0f, 1.0f);
+			if (hitPoint.material->specularHighlight > 0.0f && (diffuse > EPSILON || hitPoint.material->roughness < 1.0f)) {
+				float attenuation = lightDistance * lightDistance;
+				glm::vec3 lightDir = -toLight / lightDistance;
+				glm::vec3 reflectedLightDir = glm::reflect(lightDir, hitPoint.normal);
+				glm::vec3 cameraDir = glm::normalize(cameraPos - hitPoint.position);
+				ls.highlight = hitPoint.material->specularHighlight * lightColor * light.power / attenuation * std::pow(std::max(glm::dot(cameraDir, reflectedLightDir), 0.0f), 1.0f / std::max(hitPoint.material->specularExponent, EPSILON));
+			}
+
+			if (light.radius <= EPSILON) {
+				ls.direction = toLight / lightDistance;
+				ls.distance = lightDistance - EPSILON * 2.0f;
+				ls.contribution = evalBsdf(b, ls.direction) * lightColor * light.power * PI / (lightDistance * lightDistance);
+				return ls;
+			}
+			ls.pdf = sampleSphereCone(lightPosition, light.radius, hitPoint.position, u, ls.direction, surfaceDistance);
+			radiance = lightColor * light.power / (light.radius * light.radius);
+		}
+		else {
+			int object = (*state.emitters)[slot - lightCount];
+			if (object == hitPoint.object) return ls;
+			const scene::object& emitter = scene::objects[object];
+			const scene::material& emitterMaterial = scene::materials[emitter.mat];
+			radiance = toVec3(emitterMaterial.emission) * emitterMaterial.emissionStrength;
+			if (emitter.type == SPHERE) ls.pdf = sampleSphereCone(toVec3(emitter.position), emitter.scale[0], hitPoint.position, u, ls.direction, surfaceDistance);
+			else ls.pdf = sampleBox(toVec3(emitter.position), toVec3(emitter.scale), hitPoint.position, u, ls.direction, surfaceDistance);
+		}
+		if (ls.pdf <= 0.0f) {
+			ls.pdf = 0.0f;
+			return ls;
+		}
+
+		// 2 epsilon off the surface at the start and 2 short of the emitter at the end, so neither one shadows itself
+		ls.distance = surfaceDistance - EPSILON * 4.0f;
+		ls.contribution = evalBsdf(b, ls.direction) * radiance / ls.pdf;
+		return ls;
+	}
+
+	bool lightSampleVisible(const passState& state, const surfacePoint& hitPoint, const lightSample& ls) {
+		return !occluded(state, { hitPoint.position + ls.direction * EPSILON * 2.0f, ls.direction }, ls.distance);
+	}
+
+	// one light sample towards slot, weighed against the bounce finding the same light unless it's a point
+	glm::vec3 sampleEmitter(const passState& state, int slot, const surfacePoint& hitPoint, const bsdf& b, glm::vec3 cameraPos, glm::vec2 u) {
+		float samples = emitterSamples(state, slot);
+		if (samples <= 0.0f) return glm::vec3(0.0f);
+
+		lightSample ls = evalEmitter(state, slot, hitPoint, b, cameraPos, u);
+		glm::vec3 illumination = ls.highlight / samples;
+		if (ls.contribution == glm::vec3(0.0f) || !lightSampleVisible(state, hitPoint, ls)) return illumination;
+		float weight = ls.pdf > 0.0f ? powerHeuristic(samples * ls.pdf, bsdfPdf(b, ls.direction)) : 1.0f;
+		return illumination + ls.contribution * weight / samples;
+	}
+
+	glm::vec3 sampleLights(const passState& state, const surfacePoint& hitPoint, const bsdf& b, glm::vec3 cameraPos, const sampler& s, int bounce) {
+		const aliasTable& table = *state.lightTable;
+		if (table.empty()) return glm::vec3(0.0f);
+		glm::vec3 illumination(0.0f);
+		for (int i = 0; i < state.lightSamples; i++) {
+			glm::vec2 pick = s.get2D(lightDimension(bounce, (unsigned int)(2 * i)));
+			int slot = table.sample(pick.x, pick.y);
+			illumination += sampleEmitter(state, slot, hitPoint, b, cameraPos, s.get2D(lightDimension(bounce, (unsigned int)(2 * i + 1))));
+		}
+		return illumination;
+	}
+
+	// https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+	unsigned int packNormal(glm::vec3 n) {
+		glm::vec2 p = glm::vec2(n.x, n.y) / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+		if (n.z < 0.0f) p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * glm::vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+		return glm::packSnorm2x8(p);
+	}
+
+	glm::vec3 unpackNormal(unsigned int bits) {
+		glm::vec2 p = glm::unpackSnorm2x8((glm::uint16)(bits & 0xffffu));
+		glm::vec3 n(p, 1.0f - std::abs(p.x) - std::abs(p.y));
+		if (n.z < 0.0f) {
+			glm::vec2 folded = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+			n.x = folded.x;
+			n.y = folded.y;
+		}
+		return glm::normalize(n);
+	}
+
+	// the same 16 bytes as packReservoir in raytrace.shader
+	scene::gpuReservoir packReservoir(glm::vec2 u, int slot, float confidence, float weight, float depth, glm::vec3 normal) {
+		scene::gpuReservoir r;
+		r.u = glm::packUnorm2x16(u);
+		r.slotConfidence = (unsigned int)slot | (unsigned int)confidence << 20;
+		r.weight = weight;
+		r.normalDepth = packNormal(normal) | (unsigned int)glm::packHalf1x16(depth) << 16;
+		return r;
+	}
+
+	float lightSampleTarget(const lightSample& ls) {
+		return glm::dot(ls.contribution, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+	}
+
+	lightSample evalResampledEmitter(const passState& state, int slot, const surfacePoint& hitPoint, const bsdf& b, glm::vec3 cameraPos, glm::vec2 u) {
+		lightSample ls = evalEmitter(state, slot, hitPoint, b, cameraPos, u);
+		if (ls.pdf > 0.0f) ls.contribution *= powerHeuristic(emitterSamples(state, slot) * ls.pdf, bsdfPdf(b, ls.direction));
+		return ls;
+	}
+
+	float reservoirRandom(unsigned int& rngState) {
+		rngState = rng::hash(rngState);
+		return rng::toFloat(rngState);
+	}
+
+	// reservoir resampling at the first hit in place of sampleLights, see resampleLights in raytrace.shader. a pass only
+	// reads the half the last one wrote, and every pixel only writes its own entry, so the tiles can't race
+	glm::vec3 resampleLights(const passState& state, const surfacePoint& hitPoint, const bsdf& b, glm::vec3 cameraPos, const sampler& s) {
+		const aliasTable& table = *state.lightTable;
+		int count = (int)(scene::lights.size() + state.emitters->size());
+		size_t pixelCount = (size_t)state.width * state.height;
+		glm::ivec2 pixel(s.getPixel());
+		const scene::gpuReservoir* previous = state.reservoirs + ((state.sampleIndex + 1) & 1) * pixelCount;
+		scene::gpuReservoir* current = state.reservoirs + (state.sampleIndex & 1) * pixelCount;
+		unsigned int rngState = rng::hashCombine(rng::hashCombine(rng::hashCombine(rng::hash(state.seed), (unsigned int)pixel.x), (unsigned int)pixel.y), (unsigned int)state.sampleIndex);
+		float depth = glm::length(hitPoint.position - cameraPos);
+
+		glm::vec2 keptU(0.0f);
+		int keptSlot = 0;
+		float confidence = 0.0f;
+		float weightSum = 0.0f;
+		float target = 0.0f;
+		glm::vec3 highlights(0.0f);
+		lightSample chosen = {};
+		for (int c = 0; c < state.reservoirCandidates; c++) {
+			glm::vec2 pick = s.get2D(lightDimension(0, (unsigned int)(2 * c)));
+			int slot = table.sample(pick.x, pick.y);
+			glm::vec2 u = s.get2D(lightDimension(0, (unsigned int)(2 * c + 1)));
+			float sourcePdf = table.pdf(slot);
+			lightSample ls = evalResampledEmitter(state, slot, hitPoint, b, cameraPos, u);
+			float sampleTarget = lightSampleTarget(ls);
+			float w = sourcePdf > 0.0f ? sampleTarget / sourcePdf : 0.0f;
+			if (sourcePdf > 0.0f) highlights += ls.highlight / (sourcePdf * state.reservoirCandidates);
+			confidence += 1.0f;
+			weightSum += w;
+			if (reservoirRandom(rngState) * weightSum < w) {
+				keptSlot = slot;
+				keptU = u;
+				target = sampleTarget;
+				chosen = ls;
+			}
+		}
+
+		// visibility reuse
+		bool visible = target > 0.0f && lightSampleVisible(state, hitPoint, chosen);
+		if (!visible) weightSum = 0.0f;
+
+		// -1 is this pixel's own reservoir from the last pass, only the first passes merge
+		int neighbours = state.sampleIndex < RESERVOIR_REUSE_PASSES ? RESERVOIR_NEIGHBOURS : -1;
+		for (int n = -1; n < neighbours; n++) {
+			glm::ivec2 other = pixel;
+			if (n >= 0) {
+				float angle = 2 * PI * reservoirRandom(rngState);
+				float radius = RESERVOIR_RADIUS * state.height * std::sqrt(reservoirRandom(rngState));
+				other += glm::ivec2(glm::round(glm::vec2(std::cos(angle), std::sin(angle)) * radius));
+				if (other.x < 0 || other.y < 0 || other.x >= state.width || other.y >= state.height) continue;
+			}
+			const scene::gpuReservoir& q = previous[(size_t)other.y * state.width + other.x];
+			// empty and occluded reservoirs aren't reused at all, merging their M in darkens lit pixels next to shadows
+			int slot = (int)(q.slotConfidence & 0xfffffu);
+			float qDepth = glm::unpackHalf1x16((glm::uint16)(q.normalDepth >> 16));
+			if (q.weight <= 0.0f || slot >= count || std::abs(qDepth - depth) > 0.1f * depth || glm::dot(unpackNormal(q.normalDepth), hitPoint.normal) < 0.9f) continue;
+
+			glm::vec2 u = glm::unpackUnorm2x16(q.u);
+			lightSample ls = evalResampledEmitter(state, slot, hitPoint, b, cameraPos, u);
+			float sampleTarget = lightSampleTarget(ls);
+			float qConfidence = std::min((float)(q.slotConfidence >> 20), (float)(RESERVOIR_HISTORY * state.reservoirCandidates));
+			float w = sampleTarget * q.weight * qConfidence;
+			confidence += qConfidence;
+			weightSum += w;
+			if (reservoirRandom(rngState) * weightSum < w) {
+				keptSlot = slot;
+				keptU = u;
+				target = sampleTarget;
+				chosen = ls;
+				visible = false;
+			}
+		}
+
+		glm::vec3 illumination = highlights;
+		float weight = 0.0f;
+		if (target > 0.0f && weightSum > 0.0f) {
+			weight = weightSum / (confidence * target);
+			if (visible || lightSampleVisible(state, hitPoint, chosen)) illumination += chosen.contribution * weight;
+			else weight = 0.0f;
+		}
+		if (state.sampleIndex + 1 < RESERVOIR_REUSE_PASSES) current[(size_t)pixel.y * state.width + pixel.x] = packReservoir(keptU, keptSlot, confidence, weight, depth, hitPoint.normal);
+		return illumination;
+	}
+
+	glm::vec3 directIllumination(const passState& state, const surfacePoint& hitPoint, const bsdf& b, glm::vec3 cameraPos, const sampler& s, int bounce) {
+		glm::vec3 illumination = sampleSkyboxLight(state, hitPoint, b, s, bounce);
+		if (bounce == 0 && state.reservoirCandidates > 0 && !state.lightTable->empty()) return illumination + resampleLights(state, hitPoint, b, cameraPos, s);
+		if (state.lightSamples > 0) return illumination + sampleLights(state, hitPoint, b, cameraPos, s, bounce);
+
+		int shadowRays = std::max(state.shadowRays, 1);
+		int count = (int)(scene::lights.size() + state.emitters->size());
+		for (int slot = 0; slot < count; slot++) {
+			// every shadow ray is its own sample of this light's dimension so they stay stratified against each other
+			unsigned int dimension = lightDimension(bounce, (unsigned int)slot);
+			for (int i = 0; i < shadowRays; i++) {
+				illumination += sampleEmitter(state, slot, hitPoint, b, cameraPos, s.sample2D(s.getIndex() * shadowRays + i, dimension));
+			}
+		}
+		return illumination;
+	}
+
+	float emitterPdf(const passState& state, int object, const ray& r, const surfacePoint& hitPoint) {
+		for (unsigned int e = 0; e < state.emitters->size(); e++) {
+			if ((*state.emitters)[e] != object) continue;
+			const scene::object& emitter = scene::objects[object];
+			float pdf = emitter.type == SPHERE ? sphereConePdf(toVec3(emitter.position), emitter.scale[0], r.origin) : boxPdf(toVec3(emitter.position), toVec3(emitter.scale), r.origin, r.direction, hitPoint);
+			return emitterSamples(state, (int)(scene::lights.size() + e)) * pdf;
+		}
+		return 0.0f;
+	}
+
+	// what a ray picks up on its way to hitPoint, see emissionAlongRay in raytrace.shader
+	glm::vec3 emissionAlongRay(const passState& state, const ray& r, bool hit, const surfacePoint& hitPoint, float lastPdf) {
+		glm::vec3 emission(0.0f);
+		float hitDistance = RENDER_DISTANCE;
+		if (hit) {
+			const scene::material& material = *hitPoint.material;
+			glm::vec3 emitted = toVec3(material.emission) * material.emissionStrength;
+			if (emitted != glm::vec3(0.0f)) {
+				float weight = lastPdf > 0.0f && hitPoint.object >= 0 ? powerHeuristic(lastPdf, emitterPdf(state, hitPoint.object, r, hitPoint)) : 1.0f;
+				emission += emitted * weight;
+			}
+			hitDistance = glm::length(hitPoint.position - r.origin);
+		}
+		if (lastPdf <= 0.0f) return emission;
+
+		const std::vector<unsigned int>& indices = state.lightBVH->getIndices();
+		state.lightBVH->traverse(r.origin, r.direction, hitDistance, [&](unsigned int first, unsigned int count, float&) {
+			for (unsigned int j = first; j < first + count; j++) {
+				const scene::pointLight& light = scene::lights[indices[j]];
+				glm::vec3 lightPosition = toVec3(light.position);
+				float lightDistance;
+				if (glm::length(lightPosition - r.origin) > light.reach) continue;
+				if (!sphereIntersection(lightPosition, light.radius, r, lightDistance) || lightDistance >= hitDistance) continue;
+				float lightPdf = emitterSamples(state, (int)indices[j]) * sphereConePdf(lightPosition, light.radius, r.origin);
+				emission += toVec3(light.color) * light.power / (light.radius * light.radius) * powerHeuristic(lastPdf, lightPdf);
+			}
+			return false;
+		});
+		return emission;
+	}
+
+	// what a path does after a hit, picked by the same roulette the shader runs
+	enum class bounceType {
+		REFRACT,
+		SPECULAR,
+		DIFFUSE,
+		ABSORB
+	};
+
+	bounceType chooseBounce(const surfacePoint& hitPoint, const sampler& s, int bounce) {
+		const scene::material& material = *hitPoint.material;
+		if (material.transparent) return bounceType::REFRACT;
+
+		float specChance = glm::dot(toVec3(material.specular), glm::vec3(1.0f / 3.0f));
+		float diffChance = glm::dot(toVec3(material.albedo), glm::vec3(1.0f / 3.0f));
+
+		float sum = specChance + diffChance;
+		specChance /= sum;
+		diffChance /= sum;
+
+		float roulette = s.get1D(bounceDimension(bounce, SAMPLER_BOUNCE_TYPE));
+		if (roulette < specChance) return bounceType::SPECULAR;
+		if (diffChance > 0 && roulette < sum) return bounceType::DIFFUSE;
+		return bounceType::ABSORB;
+	}
+
+	void refractBounce(const passState& state, const surfacePoint& hitPoint, glm::vec3& rayOrigin, glm::vec3& rayDirection, glm::vec3& energy) {
+		const scene::material& material = *hitPoint.material;
+		float refractionRatio = hitPoint.frontFace ? (1.0f / material.refractiveIndex) : material.refractiveIndex;
+		float cosTheta = std::min(glm::dot(-rayDirection, hitPoint.normal), 1.0f);
+		float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+
+		if (refractionRatio * sinTheta > 1.0f || reflectance(cosTheta, refractionRatio) > state.schlickPass) {
+			rayDirection = glm::reflect(rayDirection, hitPoint.normal);
+		}
+		else {
+			rayDirection = refract(rayDirection, hitPoint.normal, refractionRatio);
+		}
+		rayOrigin = hitPoint.position + rayDirection * EPSILON;
+		energy *= toVec3(material.albedo);
+	}
+
+	// the bounces leave the pdf of the direction they picked in lastPdf, 0 when light sampling couldn't have picked it
+	void specularBounce(const surfacePoint& hitPoint, const bsdf& b, glm::vec2 u, glm::vec3& rayOrigin, glm::vec3& rayDirection, glm::vec3& energy, float& lastPdf) {
+		const scene::material& material = *hitPoint.material;
+		float smoothness = 1.0f - material.roughness;
+		float alpha = std::pow(1000.0f, smoothness * smoothness);
+		if (smoothness == 1.0f) {
+			rayDirection = glm::reflect(rayDirection, hitPoint.normal);
+		}
+		else {
+			rayDirection = sampleHemisphere(glm::reflect(rayDirection, hitPoint.normal), alpha, u);
+			lastPdf = bsdfPdf(b, rayDirection);
+		}
+		rayOrigin = hitPoint.position + rayDirection * EPSILON;
+		float f = (alpha + 2) / (alpha + 1);
+		energy *= toVec3(material.specular) * std::max(glm::dot(hitPoint.normal, rayDirection) * f, 0.0f);
+	}
+
+	void diffuseBounce(const surfacePoint& hitPoint, const bsdf& b, glm::vec2 u, glm::vec3& rayOrigin, glm::vec3& rayDirection, glm::vec3& energy, float& lastPdf) {
+		rayOrigin = hitPoint.position + hitPoint.normal * EPSILON;
+		rayDirection = sampleHemisphere(hitPoint.normal, 1.0f, u);
+		lastPdf = bsdfPdf(b, rayDirection);
+		// cosine weighted, so albedo / pi * cos over the pdf of cos / pi leaves just the albedo
+		energy *= toVec3(hitPoint.material->albedo);
+	}
+
+	// past rouletteDepth bounces a path survives with a chance based on the energy it has left, survivors are scaled up to stay unbiased
+	bool russianRoulette(const passState& state, const sampler& s, int bounce, glm::vec3& energy) {
+		// a glossy sample below the surface leaves nothing to carry, and the next hit could be right on top of this one
+		if (energy == glm::vec3(0.0f)) return false;
+		if (bounce < state.rouletteDepth) return true;
+		float survival = std::min(std::max(energy.r, std::max(energy.g, energy.b)), 1.0f);
+		if (s.get1D(bounceDimension(bounce, SAMPLER_RUSSIAN_ROULETTE)) >= survival) return false;
+		energy /= survival;
+		return true;
+	}
+
+	glm::vec3 calculateGI(const passState& state, const ray& cameraRay, const sampler& s) {
+		glm::vec3 gi(0.0f);
+		glm::vec3 rayOrigin = cameraRay.origin;
+		glm::vec3 rayDirection = cameraRay.direction;
+		glm::vec3 energy(1.0f);
+		float lastPdf = 0.0f;
+		for (int i = 0; i < state.lightBounces; i++) {
+			surfacePoint hitPoint;
+			ray r = { rayOrigin, rayDirection };
+			bool hit = raycast(state, r, hitPoint);
+
+			// emission
+			gi += energy * emissionAlongRay(state, r, hit, hitPoint, lastPdf);
+
+			if (hit) {
+				bsdf b = getBsdf(hitPoint, rayDirection);
+
+				// DI
+				gi += energy * directIllumination(state, hitPoint, b, rayOrigin, s, i);
+
+				// II
+				lastPdf = 0.0f;
+				switch (chooseBounce(hitPoint, s, i)) {
+				case bounceType::REFRACT: refractBounce(state, hitPoint, rayOrigin, rayDirection, energy); break;
+				case bounceType::SPECULAR: specularBounce(hitPoint, b, s.get2D(bounceDimension(i, SAMPLER_BSDF)), rayOrigin, rayDirection, energy, lastPdf); break;
+				case bounceType::DIFFUSE: diffuseBounce(hitPoint, b, s.get2D(bounceDimension(i, SAMPLER_BSDF)), rayOrigin, rayDirection, energy, lastPdf); break;
+				default: return gi;
+				}
+
+				if (!russianRoulette(state, s, i, energy)) break;
+			}
+			else {
+				// skybox, weighed against the sky samples after any bounce that has a pdf
+				float weight = lastPdf > 0.0f ? powerHeuristic(lastPdf, skyboxPdf(state, rayDirection)) : 1.0f;
+				gi += energy * sampleSkybox(state, rayDirection) * weight;
+				break;
+			}
+		}
+
+		return gi;
+	}
+
+	ray cameraRay(const cpuCamera& camera, int width, int height, int x, int y, bool jitter, const sampler& s) {
+		const float blur = 0.002f;
+		glm::vec2 fragUV((x + 0.5f) / width, (y + 0.5f) / height);
+		glm::vec2 centeredUV = (fragUV * 2.0f - glm::vec2(1)) * glm::vec2(camera.aspectRatio, 1.0f);
+
+		if (jitter) centeredUV += (s.get2D(SAMPLER_PIXEL_DIMENSION) - glm::vec2(0.5f)) * blur;
+		return { camera.position, glm::vec3(glm::normalize(glm::vec4(centeredUV, -1.0f, 0.0f)) * camera.rotationMatrix) };
+	}
+
+	// spreads the low 5 bits out to every third bit for a morton code
+	inline unsigned int spreadBits(unsigned int v) {
+		v &= 0x1f;
+		v = (v | (v << 8)) & 0x0f00f;
+		v = (v | (v << 4)) & 0xc30c3;
+		v = (v | (v << 2)) & 0x249249;
+		return v;
+	}
+
+	inline unsigned int directionOctant(glm::vec3 direction) {
+		return (direction.x < 0 ? 1 : 0) | (direction.y < 0 ? 2 : 0) | (direction.z < 0 ? 4 : 0);
+	}
+
+	// bin key for a secondary ray: direction octant on top, then the morton code of the grid cell its origin is in
+	// so rays in one bin start close together and head the same way, and neighbouring bins are neighbouring cells
+	unsigned int rayBinKey(glm::vec3 origin, glm::vec3 direction, glm::vec3 boundsMin, glm::vec3 cellScale) {
+		glm::ivec3 cell = glm::clamp(glm::ivec3((origin - boundsMin) * cellScale), glm::ivec3(0), glm::ivec3(RAY_BIN_RESOLUTION - 1));
+		return (directionOctant(direction) << 15) | (spreadBits(cell.x) << 2) | (spreadBits(cell.y) << 1) | spreadBits(cell.z);
+	}
+
+	sampler pixelSampler(const passState& state, int x, int y) {
+		return sampler(state.sampling, glm::uvec2(x, y), (unsigned int)state.sampleIndex, state.seed, state.noise);
+	}
+
+	// one path in wavefront mode, the loop variables of calculateGI pulled out so each stage can pick up where the last one stopped
+	struct pathState {
+		glm::vec3 origin;
+		glm::vec3 direction;
+		glm::vec3 energy;
+		glm::vec3 gi;
+		float lastPdf;
+		surfacePoint hitPoint;
+		bsdf hitBsdf;
+		sampler pathSampler;
+		int x, y;
+	};
+	passState capturePassState(const hdrImage* skybox, const skyboxDistribution* skyboxTable, const bvh* objectBVH, const objectSoA* objects, const aliasTable* lightTable, const std::vector<int>* emitters, const bvh* lightBVH, scene::gpuReservoir* reservoirs, int width, int height, float schlickPass, const blueNoise* noise, int sampleIndex) {
+		passState state;
+		state.skybox = skybox;
+		state.skyboxTable = skyboxTable;
+		state.objectBVH = objectBVH;
+		state.objects = objects;
+		state.schlickPass = schlickPass;
+		state.shadowRays = scene::shadowRays;
+		state.lightSamples = scene::lightSamples;
+		state.reservoirCandidates = reservoirs ? scene::reservoirCandidates : 0;
+		state.reservoirs = reservoirs;
+		state.width = width;
+		state.height = height;
+		state.lightTable = lightTable;
+		state.emitters = emitters;
+		state.lightBVH = lightBVH;
+		state.lightBounces = scene::lightBounces;
+		state.rouletteDepth = scene::rouletteDepth;
+		state.sampling = (samplerType)scene::samplingMethod;
+		state.noise = noise;
+		state.sampleIndex = sampleIndex;
+		state.seed = (unsigned int)scene::randomSeed;
+		state.skyboxGamma = scene::skyboxGamma;
+		state.skyboxStrength = scene::skyboxStrength;
+		state.planeVisible = scene::planeVisible;
+		state.planeMaterial = &scene::materials[scene::planeMaterial];
+		return state;
+	}
+}
+
+cpuRenderer::cpuRenderer(int width, int height, unsigned int threadCount, int tileSize)
+	: m_width(width), m_height(height), m_scheduler(threadCount, tileSize), m_skybox(nullptr), m_geometryVersion(0), m_bvhBuilt(false), m_lightVersion(0), m_lightTableBuilt(false), m_mode(renderMode::MEGAKERNEL), m_raySorting(false),
+	m_accumulatedPasses(0), m_schlickPass(1.0f), m_increment(true) {
+	m_accumulation.assign((size_t)m_width * m_height * 3, 0.0f);
+}
+
+void cpuRenderer::setSkybox(const hdrImage* skybox) {
+	m_skybox = skybox;
+	if (skybox && skybox->isLoaded()) m_skyboxTable.build(skybox->getPixels(), skybox->getWidth(), skybox->getHeight(), 3, scene::skyboxGamma, getThreadCount());
+	else m_skyboxTable = skyboxDistribution();
+}
+
+void cpuRenderer::reset() {
+	std::fill(m_accumulation.begin(), m_accumulation.end(), 0.0f);
+	std::fill(m_reservoirs.begin(), m_reservoirs.end(), scene::gpuReservoir());
+	m_accumulatedPasses = 0;
+	m_schlickPass = 1.0f;
+	m_increment = true;
+}
+
+// path pool and stage queues for one thread, queues hold indices into paths
+struct wavefrontPool {
+	std::vector<pathState> paths;
+	std::vector<unsigned int> extend;
+	std::vector<unsigned int> miss;
+	std::vector<unsigned int> shadow;
+	std::vector<unsigned int> refractive;
+	std::vector<unsigned int> specular;
+	std::vector<unsigned int> diffuse;
+	std::vector<std::pair<unsigned int, unsigned int>> bins; // key, path index
+};
+
+cpuRenderer::~cpuRenderer() {
+
+}
+
+void cpuRenderer::setMode(renderMode mode) {
+	m_mode = mode;
+}
+
+void cpuRenderer::setRaySorting(bool enabled) {
+	m_raySorting = enabled;
+}
+
+// reorders the extend queue so the next bounce traces each bin (origin cell + direction octant) as one coherent run
+void cpuRenderer::sortRays(wavefrontPool& pool) const {
+	if (pool.extend.size() < 2 || m_bvh.getNodes().empty()) return;
+
+	const bvhNode& root = m_bvh.getNodes()[0];
+	glm::vec3 boundsMin(root.min[0], root.min[1], root.min[2]);
+	glm::vec3 boundsMax(root.max[0], root.max[1], root.max[2]);
+	glm::vec3 cellScale = (float)RAY_BIN_RESOLUTION / glm::max(boundsMax - boundsMin, glm::vec3(EPSILON));
+
+	pool.bins.clear();
+	for (unsigned int index : pool.extend) {
+		const pathState& path = pool.paths[index];
+		pool.bins.push_back({ rayBinKey(path.origin, path.direction, boundsMin, cellScale), index });
+	}
+	std::sort(pool.bins.begin(), pool.bins.end());
+
+	for (size_t i = 0; i < pool.bins.size(); i++) {
+		pool.extend[i] = pool.bins[i].second;
+	}
+}
+
+void cpuRenderer::addSample(int x, int y, glm::vec3 color) {
+	float* pixel = &m_accumulation[((size_t)y * m_width + x) * 3];
+	pixel[0] += color.x;
+	pixel[1] += color.y;
+	pixel[2] += color.z;
+}
+
+void cpuRenderer::renderTile(const cpuCamera& camera, const tile& t) {
+	passState state = capturePassState(m_skybox, &m_skyboxTable, &m_bvh, &m_objects, &m_lightTable, &m_emitters, &m_lightBVH, m_reservoirs.empty() ? nullptr : m_reservoirs.data(), m_width, m_height, m_schlickPass, &m_blueNoise, m_accumulatedPasses);
+
+	for (int y = t.y; y < t.y + t.height; y++) {
+		for (int x = t.x; x < t.x + t.width; x++) {
+			sampler s = pixelSampler(state, x, y);
+			addSample(x, y, calculateGI(state, cameraRay(camera, m_width, m_height, x, y, m_accumulatedPasses > 0, s), s));
+		}
+	}
+}
+
+// calculateGI split into stages that each run over every path queued for them before the next stage starts,
+// so a stage only ever runs one kind of work instead of every path branching its own way through the loop
+void cpuRenderer::renderTileWavefront(const cpuCamera& camera, const tile& t, wavefrontPool& pool) {
+	passState state = capturePassState(m_skybox, &m_skyboxTable, &m_bvh, &m_objects, &m_lightTable, &m_emitters, &m_lightBVH, m_reservoirs.empty() ? nullptr : m_reservoirs.data(), m_width, m_height, m_schlickPass, &m_blueNoise, m_accumulatedPasses);
+
+	pool.paths.resize((size_t)t.width * t.height);
+	pool.extend.clear();
+	for (int y = t.y; y < t.y + t.height; y++) {
+		for (int x = t.x; x < t.x + t.width; x++) {
+			unsigned int index = (unsigned int)((y - t.y) * t.width + (x - t.x));
+			pathState& path = pool.paths[index];
+			path.pathSampler = pixelSampler(state, x, y);
+			ray r = cameraRay(camera, m_width, m_height, x, y, m_accumulatedPasses > 0, path.pathSampler);
+			path.origin = r.origin;
+			path.direction = r.direction;
+			path.energy = glm::vec3(1.0f);
+			path.gi = glm::vec3(0.0f);
+			path.lastPdf = 0.0f;
+			path.x = x;
+			path.y = y;
+			pool.extend.push_back(index);
+		}
+	}
+
+	for (int bounce = 0; bounce < state.lightBounces && !pool.extend.empty(); bounce++) {
+		pool.miss.clear();
+		pool.shadow.clear();
+		pool.refractive.clear();
+		pool.specular.clear();
+		pool.diffuse.clear();
+
+		// extend: closest hit, emission and sorting the hits by what they do next. with sorting on, runs of rays with
+		// the same direction octant go through the bvh as packets, sorted that's rays from neighbouring cells and
+		// on the first bounce it's neighbouring camera rays
+		for (size_t begin = 0; begin < pool.extend.size();) {
+			unsigned int count = 1;
+			ray rays[SIMD_PACKET_SIZE];
+			bool hits[SIMD_PACKET_SIZE];
+			surfacePoint hitPoints[SIMD_PACKET_SIZE];
+			rays[0] = { pool.paths[pool.extend[begin]].origin, pool.paths[pool.extend[begin]].direction };
+			unsigned int octant = directionOctant(rays[0].direction);
+			while (m_raySorting && count < SIMD_PACKET_SIZE && begin + count < pool.extend.size()) {
+				const pathState& next = pool.paths[pool.extend[begin + count]];
+				if (directionOctant(next.direction) != octant) break;
+				rays[count++] = { next.origin, next.direction };
+			}
+			if (count > 1) raycastPacket(state, rays, count, hitPoints, hits);
+			else hits[0] = raycast(state, rays[0], hitPoints[0]);
+
+			for (unsigned int i = 0; i < count; i++) {
+				unsigned int index = pool.extend[begin + i];
+				pathState& path = pool.paths[index];
+				path.hitPoint = hitPoints[i];
+				path.gi += path.energy * emissionAlongRay(state, rays[i], hits[i], path.hitPoint, path.lastPdf);
+				if (!hits[i]) {
+					pool.miss.push_back(index);
+					continue;
+				}
+
+				path.hitBsdf = getBsdf(path.hitPoint, path.direction);
+				path.lastPdf = 0.0f;
+				pool.shadow.push_back(index);
+
+				switch (chooseBounce(path.hitPoint, path.pathSampler, bounce)) {
+				case bounceType::REFRACT: pool.refractive.push_back(index); break;
+				case bounceType::SPECULAR: pool.specular.push_back(index); break;
+				case bounceType::DIFFUSE: pool.diffuse.push_back(index); break;
+				default: break;
+				}
+			}
+			begin += count;
+		}
+
+		for (unsigned int index : pool.miss) {
+			pathState& path = pool.paths[index];
+			float weight = path.lastPdf > 0.0f ? powerHeuristic(path.lastPdf, skyboxPdf(state, path.direction)) : 1.0f;
+			path.gi += path.energy * sampleSkybox(state, path.direction) * weight;
+		}
+
+		// shadow has to run before the bounces below since it uses the energy and origin from this bounce
+		for (unsigned int index : pool.shadow) {
+			pathState& path = pool.paths[index];
+			path.gi += path.energy * directIllumination(state, path.hitPoint, path.hitBsdf, path.origin, path.pathSampler, bounce);
+		}
+
+		pool.extend.clear();
+		for (unsigned int index : pool.refractive) {
+			pathState& path = pool.paths[index];
+			refractBounce(state, path.hitPoint, path.origin, path.direction, path.energy);
+			if (russianRoulette(state, path.pathSampler, bounce, path.energy)) pool.extend.push_back(index);
+		}
+		for (unsigned int index : pool.specular) {
+			pathState& path = pool.paths[index];
+			specularBounce(path.hitPoint, path.hitBsdf, path.pathSampler.get2D(bounceDimension(bounce, SAMPLER_BSDF)), path.origin, path.direction, path.energy, path.lastPdf);
+			if (russianRoulette(state, path.pathSampler, bounce, path.energy)) pool.extend.push_back(index);
+		}
+		for (unsigned int index : pool.diffuse) {
+			pathState& path = pool.paths[index];
+			diffuseBounce(path.hitPoint, path.hitBsdf, path.pathSampler.get2D(bounceDimension(bounce, SAMPLER_BSDF)), path.origin, path.direction, path.energy, path.lastPdf);
+			if (russianRoulette(state, path.pathSampler, bounce, path.energy)) pool.extend.push_back(index);
+		}
+
+		if (m_raySorting) sortRays(pool);
+	}
+
+	for (const pathState& path : pool.paths) {
+		addSample(path.x, path.y, path.gi);
+	}
+}
+
+void cpuRenderer::renderPass(const cpuCamera& camera) {
+	// only rebuilt when something moved, material edits are read straight from the scene
+	if (!m_bvhBuilt || m_geometryVersion != scene::getGeometryVersion()) {
+		// leaves as wide as the simd kernel so one leaf is one intersection call
+		m_bvh.build(scene::objects, std::max((unsigned int)BVH_MAX_LEAF_SIZE, simd::getWidth()));
+		m_objects.build(scene::objects, m_bvh.getIndices());
+		m_geometryVersion = scene::getGeometryVersion();
+		m_bvhBuilt = true;
+	}
+	// objects and materials decide which emitters go in the table too, the versions only ever grow so their sum
+	// changes whenever any of them does
+	unsigned int lightVersion = scene::getLightVersion() + scene::getObjectVersion() + scene::getMaterialVersion();
+	if (!m_lightTableBuilt || m_lightVersion != lightVersion) {
+		m_emitters = scene::findEmitters();
+		scene::buildLightTable(m_lightTable, m_emitters);
+		scene::buildLightBVH(m_lightBVH);
+		m_lightVersion = lightVersion;
+		m_lightTableBuilt = true;
+	}
+	if (scene::reservoirCandidates > 0 && m_reservoirs.empty()) m_reservoirs.assign((size_t)m_width * m_height * 2, scene::gpuReservoir());
+
+	if (m_mode == renderMode::WAVEFRONT) {
+		while (m_pools.size() < m_scheduler.getThreadCount()) m_pools.push_back(std::make_unique<wavefrontPool>());
+		m_scheduler.run(m_width, m_height, [&](const tile& t, unsigned int thread) {
+			renderTileWavefront(camera, t, *m_pools[thread]);
+		});
+	}
+	else {
+		m_scheduler.run(m_width, m_height, [&](const tile& t, unsigned int) {
+			renderTile(camera, t);
+		});
+	}
+
+	m_accumulatedPasses++;
+
+	// same schedule main() uses for u_schlickPass
+	if (m_schlickPass > 0 && m_increment) {
+		m_schlickPass -= 0.1f;
+	}
+	else if (m_schlickPass < 0) {
+		m_increment = false;
+	}
+
+	if (!m_increment) {
+		m_schlickPass = rng::uniform((unsigned int)scene::randomSeed, (unsigned int)m_accumulatedPasses - 1);
+	}
+}
+
+// average of every pass so far, same as the u_directPass draw
+void cpuRenderer::resolve(std::vector<float>& output) const {
+	output.resize(m_accumulation.size());
+	float passes = (float)std::max(m_accumulatedPasses, 1);
+	for (size_t i = 0; i < m_accumulation.size(); i++) {
+		output[i] = m_accumulation[i] / passes;
+	}
+}
+
+bool cpuRenderer::writePFM(const std::string& path) const {
+	std::vector<float> pixels;
+	resolve(pixels);
+	return hdrImage::writePFM(path, m_width, m_height, pixels.data());
+}
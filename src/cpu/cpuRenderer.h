@@ -0,0 +1,83 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "objectSoA.h"
+#include "tileScheduler.h"
+#include "../aliasTable.h"
+#include "../blueNoise.h"
+#include "../bvh.h"
+#include "../scene.h"
+#include "../skyboxDistribution.h"
+
+class hdrImage;
+struct wavefrontPool;
+
+struct cpuCamera {
+	glm::vec3 position;
+	glm::mat4 rotationMatrix;
+	float aspectRatio;
+};
+
+enum class renderMode {
+	MEGAKERNEL = 0, // one loop per pixel, same as the shader
+	WAVEFRONT = 1 // paths kept in a pool and advanced a stage at a time over queues
+};
+
+// headless path tracer, a straight port of raytrace.shader that reads the scene namespace directly
+// every pass adds one sample per pixel to a float framebuffer, just like the accumulation pass on the gpu
+class cpuRenderer {
+private:
+	int m_width, m_height;
+	tileScheduler m_scheduler;
+	const hdrImage* m_skybox;
+	skyboxDistribution m_skyboxTable; // built by setSkybox
+	bvh m_bvh;
+	objectSoA m_objects;
+	unsigned int m_geometryVersion; // scene::getGeometryVersion() the bvh was built from
+	bool m_bvhBuilt;
+	aliasTable m_lightTable; // picks lights and emitters for scene::lightSamples
+	std::vector<int> m_emitters; // scene::findEmitters() the table was built with
+	bvh m_lightBVH; // light spheres for bounce rays, rebuilt with the table
+	std::vector<scene::gpuReservoir> m_reservoirs; // both halves for scene::reservoirCandidates, emptied by reset()
+	unsigned int m_lightVersion;
+	bool m_lightTableBuilt;
+	blueNoise m_blueNoise;
+	renderMode m_mode;
+	bool m_raySorting; // wavefront only, bins secondary rays before every extend stage and traces them as packets
+	std::vector<std::unique_ptr<wavefrontPool>> m_pools; // one per scheduler thread
+
+	std::vector<float> m_accumulation; // rgb, bottom row first like the gl framebuffer
+	int m_accumulatedPasses;
+	float m_schlickPass;
+	bool m_increment;
+
+	void addSample(int x, int y, glm::vec3 color);
+	void renderTile(const cpuCamera& camera, const tile& t);
+	void sortRays(wavefrontPool& pool) const;
+	void renderTileWavefront(const cpuCamera& camera, const tile& t, wavefrontPool& pool);
+public:
+	cpuRenderer(int width, int height, unsigned int threadCount = 0, int tileSize = 32);
+	~cpuRenderer();
+
+	void setSkybox(const hdrImage* skybox);
+	void setMode(renderMode mode);
+	void setRaySorting(bool enabled);
+	void reset();
+	void renderPass(const cpuCamera& camera); // deterministic, the same scene::randomSeed gives the same image
+	void resolve(std::vector<float>& output) const;
+	bool writePFM(const std::string& path) const;
+
+	inline int getWidth() const { return m_width; }
+	inline int getHeight() const { return m_height; }
+	inline renderMode getMode() const { return m_mode; }
+	inline bool getRaySorting() const { return m_raySorting; }
+	inline const skyboxDistribution& getSkyboxDistribution() const { return m_skyboxTable; }
+	inline tileScheduler& getScheduler() { return m_scheduler; }
+	inline unsigned int getThreadCount() const { return m_scheduler.getThreadCount(); }
+	inline int getAccumulatedPasses() const { return m_accumulatedPasses; }
+};
@@ -0,0 +1,111 @@
+#include "hdrImage.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "../vendor/stb/stb_image.h"
+
+hdrImage::hdrImage() : m_width(0), m_height(0) {
+
+}
+
+hdrImage::hdrImage(const std::string& path) : m_width(0), m_height(0) {
+	load(path);
+}
+
+bool hdrImage::load(const std::string& path) {
+	m_filePath = path;
+	m_pixels.clear();
+	m_width = 0;
+	m_height = 0;
+	if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".pfm") == 0) return loadPFM(path);
+
+	int channels;
+	stbi_set_flip_vertically_on_load(1);
+	float* data = stbi_loadf(path.c_str(), &m_width, &m_height, &channels, 3);
+	if (!data) {
+		std::cout << "Failed to load image '" << path << "'" << std::endl;
+		m_width = 0;
+		m_height = 0;
+		return false;
+	}
+
+	m_pixels.assign(data, data + (size_t)m_width * m_height * 3);
+	stbi_image_free(data);
+	return true;
+}
+
+// stb_image doesn't do pfm, and it's what the renderers write so comparing two renders needs it
+bool hdrImage::loadPFM(const std::string& path) {
+	std::ifstream file(path, std::ios::binary);
+	std::string magic;
+	int width = 0, height = 0;
+	float scale = 0.0f;
+	// exactly one whitespace character between the header and the data
+	if (!(file >> magic >> width >> height >> scale) || magic != "PF" || width <= 0 || height <= 0 || scale == 0.0f) {
+		std::cout << "Failed to load image '" << path << "', only rgb pfms are supported" << std::endl;
+		return false;
+	}
+	file.get();
+
+	std::vector<float> pixels((size_t)width * height * 3);
+	if (!file.read((char*)pixels.data(), pixels.size() * sizeof(float))) {
+		std::cout << "Failed to load image '" << path << "', it's cut short" << std::endl;
+		return false;
+	}
+	// a positive scale means big endian
+	if (scale > 0.0f) {
+		for (float& f : pixels) {
+			uint32_t bits;
+			memcpy(&bits, &f, sizeof(bits));
+			bits = (bits >> 24) | ((bits >> 8) & 0xff00) | ((bits << 8) & 0xff0000) | (bits << 24);
+			memcpy(&f, &bits, sizeof(bits));
+		}
+	}
+
+	m_pixels = std::move(pixels);
+	m_width = width;
+	m_height = height;
+	return true;
+}
+
+bool hdrImage::writePFM(const std::string& path, int width, int height, const float* pixels) {
+	std::ofstream file(path, std::ios::binary);
+	if (!file) return false;
+
+	file << "PF\n" << width << " " << height << "\n-1.0\n";
+	file.write((const char*)pixels, (size_t)width * height * 3 * sizeof(float));
+	return (bool)file;
+}
+
+glm::vec3 hdrImage::texel(int x, int y) const {
+	// GL_REPEAT
+	x %= m_width;
+	y %= m_height;
+	if (x < 0) x += m_width;
+	if (y < 0) y += m_height;
+
+	const float* p = &m_pixels[((size_t)y * m_width + x) * 3];
+	return glm::vec3(p[0], p[1], p[2]);
+}
+
+// bilinear filtering with texel centers at (i + 0.5) / size, same as GL_LINEAR
+glm::vec3 hdrImage::sample(float u, float v) const {
+	if (m_pixels.empty()) return glm::vec3(0.0f);
+
+	float x = u * m_width - 0.5f;
+	float y = v * m_height - 0.5f;
+	float x0 = std::floor(x);
+	float y0 = std::floor(y);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	int ix = (int)x0;
+	int iy = (int)y0;
+	glm::vec3 bottom = glm::mix(texel(ix, iy), texel(ix + 1, iy), fx);
+	glm::vec3 top = glm::mix(texel(ix, iy + 1), texel(ix + 1, iy + 1), fx);
+	return glm::mix(bottom, top, fy);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// cpu side copy of an hdr image, sampled the same way the gpu samples a GL_LINEAR / GL_REPEAT texture
+class hdrImage {
+private:
+	std::string m_filePath;
+	std::vector<float> m_pixels; // rgb, bottom row first (flipped on load like texture)
+	int m_width, m_height;
+
+	glm::vec3 texel(int x, int y) const;
+	bool loadPFM(const std::string& path);
+public:
+	hdrImage();
+	hdrImage(const std::string& path);
+
+	bool load(const std::string& path); // anything stb_image reads, plus .pfm
+	glm::vec3 sample(float u, float v) const;
+
+	inline bool isLoaded() const { return !m_pixels.empty(); }
+	inline int getWidth() const { return m_width; }
+	inline int getHeight() const { return m_height; }
+	inline const float* getPixels() const { return m_pixels.data(); }
+
+	// portable float map, rgb rows bottom to top which is already our layout
+	static bool writePFM(const std::string& path, int width, int height, const float* pixels);
+};
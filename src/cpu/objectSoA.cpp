@@ -0,0 +1,32 @@
+#include "objectSoA.h"
+
+objectSoA::objectSoA() : m_count(0) {
+
+}
+
+void objectSoA::build(const std::vector<scene::object>& objects, const std::vector<unsigned int>& order) {
+	m_count = (unsigned int)order.size();
+	// one extra block of padding so a kernel starting at any lane can read 8 floats past it
+	unsigned int padded = (m_count + SOA_PADDING - 1) / SOA_PADDING * SOA_PADDING + SOA_PADDING;
+
+	m_positionX.assign(padded, 0.0f);
+	m_positionY.assign(padded, 0.0f);
+	m_positionZ.assign(padded, 0.0f);
+	m_scaleX.assign(padded, 0.0f);
+	m_scaleY.assign(padded, 0.0f);
+	m_scaleZ.assign(padded, 0.0f);
+	m_type.assign(padded, 0);
+	m_objectIndex.assign(padded, 0);
+
+	for (unsigned int lane = 0; lane < m_count; lane++) {
+		const scene::object& o = objects[order[lane]];
+		m_positionX[lane] = o.position[0];
+		m_positionY[lane] = o.position[1];
+		m_positionZ[lane] = o.position[2];
+		m_scaleX[lane] = o.scale[0];
+		m_scaleY[lane] = o.scale[1];
+		m_scaleZ[lane] = o.scale[2];
+		m_type[lane] = (int)o.type;
+		m_objectIndex[lane] = order[lane];
+	}
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include "../scene.h"
+
+#define SOA_PADDING 8
+
+// structure of arrays copy of scene::objects, laid out in bvh leaf order so a leaf is one contiguous run of lanes
+// padded with type 0 entries up to a multiple of 8 so the simd kernels can always load full registers
+class objectSoA {
+private:
+	std::vector<float> m_positionX, m_positionY, m_positionZ;
+	std::vector<float> m_scaleX, m_scaleY, m_scaleZ;
+	std::vector<int> m_type;
+	std::vector<unsigned int> m_objectIndex; // lane -> index into scene::objects
+	unsigned int m_count;
+public:
+	objectSoA();
+
+	void build(const std::vector<scene::object>& objects, const std::vector<unsigned int>& order);
+
+	inline unsigned int getCount() const { return m_count; }
+	inline unsigned int getObjectIndex(unsigned int lane) const { return m_objectIndex[lane]; }
+
+	inline const float* positionX() const { return m_positionX.data(); }
+	inline const float* positionY() const { return m_positionY.data(); }
+	inline const float* positionZ() const { return m_positionZ.data(); }
+	inline const float* scaleX() const { return m_scaleX.data(); }
+	inline const float* scaleY() const { return m_scaleY.data(); }
+	inline const float* scaleZ() const { return m_scaleZ.data(); }
+	inline const int* type() const { return m_type.data(); }
+};
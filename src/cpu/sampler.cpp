@@ -0,0 +1,87 @@
+#include "sampler.h"
+
+#include <cmath>
+
+#include "../blueNoise.h"
+#include "../rng.h"
+
+// the hashes and sequences here are written the same way as the glsl versions so both renderers draw the same numbers
+namespace {
+	inline float fract(float x) {
+		return x - std::floor(x);
+	}
+
+	unsigned int reverseBits(unsigned int x) {
+		x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+		x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+		x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+		x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+		return (x >> 16) | (x << 16);
+	}
+
+	// Laine-Karras style hash from Burley's "Practical Hash-based Owen Scrambling"
+	unsigned int laineKarrasPermutation(unsigned int x, unsigned int seed) {
+		x += seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return x;
+	}
+
+	unsigned int nestedUniformScramble(unsigned int x, unsigned int seed) {
+		return reverseBits(laineKarrasPermutation(reverseBits(x), seed));
+	}
+
+	// second sobol dimension, the first is just the bit reversed index
+	unsigned int sobol1(unsigned int index) {
+		unsigned int result = 0;
+		for (unsigned int v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1) {
+			if (index & 1u) result ^= v;
+		}
+		return result;
+	}
+}
+
+sampler::sampler() : m_type(samplerType::RANDOM), m_pixel(0), m_index(0), m_seedHash(0), m_pixelHash(0), m_blueNoise(nullptr) {
+
+}
+
+sampler::sampler(samplerType type, glm::uvec2 pixel, unsigned int index, unsigned int seed, const blueNoise* noise)
+	: m_type(type), m_pixel(pixel), m_index(index), m_blueNoise(noise) {
+	m_seedHash = rng::hash(seed);
+	m_pixelHash = rng::hashCombine(rng::hashCombine(m_seedHash, pixel.x), pixel.y);
+}
+
+glm::vec2 sampler::sample2D(unsigned int index, unsigned int dimension) const {
+	switch (m_type) {
+	case samplerType::SOBOL: return sobol2D(index, dimension);
+	case samplerType::BLUE_NOISE: return m_blueNoise ? blueNoise2D(index, dimension) : sobol2D(index, dimension);
+	default: return random2D(index, dimension);
+	}
+}
+
+// plain pcg hash of (seed, pixel, index, dimension), uncorrelated but not stratified
+glm::vec2 sampler::random2D(unsigned int index, unsigned int dimension) const {
+	unsigned int h = rng::hashCombine(rng::hashCombine(m_pixelHash, index), dimension);
+	return glm::vec2(rng::toFloat(h), rng::toFloat(rng::hash(h)));
+}
+
+// owen scrambled sobol (0, 2) sequence, the index gets shuffled per pixel and dimension so every dimension is its own
+// well stratified 2d set without needing hundreds of sobol dimensions
+glm::vec2 sampler::sobol2D(unsigned int index, unsigned int dimension) const {
+	unsigned int seed = rng::hashCombine(m_pixelHash, dimension);
+	index = nestedUniformScramble(index, seed);
+	unsigned int x = nestedUniformScramble(reverseBits(index), rng::hashCombine(seed, 0u));
+	unsigned int y = nestedUniformScramble(sobol1(index), rng::hashCombine(seed, 1u));
+	return glm::vec2(rng::toFloat(x), rng::toFloat(y));
+}
+
+// each dimension reads the tile at its own offset, the r2 sequence then moves every pixel along from sample to sample
+glm::vec2 sampler::blueNoise2D(unsigned int index, unsigned int dimension) const {
+	// offsets only depend on the seed, not the pixel, or the tile's structure would get scrambled away
+	unsigned int offsetX = rng::hashCombine(m_seedHash, dimension), offsetY = rng::hash(offsetX);
+	glm::vec2 noise(m_blueNoise->sample((int)((m_pixel.x + offsetX) & 0x7fffffffu), (int)((m_pixel.y + offsetY) & 0x7fffffffu)),
+		m_blueNoise->sample((int)((m_pixel.x + offsetY) & 0x7fffffffu), (int)((m_pixel.y + offsetX) & 0x7fffffffu)));
+	return glm::vec2(fract(noise.x + (float)index * 0.7548776662f), fract(noise.y + (float)index * 0.5698402910f));
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+class blueNoise;
+
+// matches the SAMPLER_ defines in raytrace.shader and scene::samplerType
+enum class samplerType {
+	RANDOM = 0,
+	SOBOL = 1,
+	BLUE_NOISE = 2
+};
+
+// how the sample dimensions of one path are laid out, same as the SAMPLER_ defines in the shader
+#define SAMPLER_PIXEL_DIMENSION 0 // bounces start right after it
+#define SAMPLER_BOUNCE_DIMENSIONS 5
+#define SAMPLER_BOUNCE_TYPE 0 // offsets inside a bounce
+#define SAMPLER_BSDF 1
+#define SAMPLER_RUSSIAN_ROULETTE 2
+#define SAMPLER_SKYBOX 3 // picks the cell, + 1 for the point in it
+#define SAMPLER_LIGHT_DIMENSIONS 0x80000000u // light samples and reservoir candidates get a range of their own past every bounce block
+
+// per pixel sample generator, the cpu copy of the sampler in raytrace.shader
+// every value is a function of (pixel, sample index, dimension) so paths can be resumed in any order
+class sampler {
+private:
+	samplerType m_type;
+	glm::uvec2 m_pixel;
+	unsigned int m_index;
+	unsigned int m_seedHash;
+	unsigned int m_pixelHash; // seed and pixel hashed together once, every dimension starts from it
+	const blueNoise* m_blueNoise;
+
+	glm::vec2 random2D(unsigned int index, unsigned int dimension) const;
+	glm::vec2 sobol2D(unsigned int index, unsigned int dimension) const;
+	glm::vec2 blueNoise2D(unsigned int index, unsigned int dimension) const;
+public:
+	sampler();
+	sampler(samplerType type, glm::uvec2 pixel, unsigned int index, unsigned int seed, const blueNoise* noise);
+
+	// 1d dimensions just use the first half of a 2d one
+	glm::vec2 sample2D(unsigned int index, unsigned int dimension) const;
+
+	inline float get1D(unsigned int dimension) const { return sample2D(m_index, dimension).x; }
+	inline glm::vec2 get2D(unsigned int dimension) const { return sample2D(m_index, dimension); }
+
+	inline unsigned int getIndex() const { return m_index; }
+	inline glm::uvec2 getPixel() const { return m_pixel; }
+};
+
+inline unsigned int bounceDimension(int bounce, unsigned int offset) {
+	return 1 + bounce * SAMPLER_BOUNCE_DIMENSIONS + offset;
+}
+
+// light index (emitters after the lights), or with scene::lightSamples 2 * sample to pick one and + 1 for the direction
+// to it, and the same for reservoir candidates at the first hit. 65536 of them per bounce, as many as any scene has
+inline unsigned int lightDimension(int bounce, unsigned int offset) {
+	return SAMPLER_LIGHT_DIMENSIONS | ((unsigned int)bounce << 16) | offset;
+}
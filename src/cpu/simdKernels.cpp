@@ -0,0 +1,409 @@
+#include "simdKernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "objectSoA.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// msvc lets us use any intrinsic without /arch, the dispatch makes sure we only call what the cpu has
+#define TARGET_SSE4
+#define TARGET_AVX2
+#else
+#define TARGET_SSE4 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+	const float BOX_FAR = 1000000000000.0f;
+
+	// these two are the same tests as sphereIntersection / boxIntersection in cpuRenderer.cpp, lane by lane
+	bool sphereLane(const objectSoA& soa, unsigned int i, const glm::vec3& origin, const glm::vec3& direction, float& hitDistance) {
+		glm::vec3 relativeOrigin = origin - glm::vec3(soa.positionX()[i], soa.positionY()[i], soa.positionZ()[i]);
+		float radius = soa.scaleX()[i];
+
+		float a = glm::dot(direction, direction);
+		float half_b = glm::dot(relativeOrigin, direction);
+		float c = glm::dot(relativeOrigin, relativeOrigin) - radius * radius;
+
+		float discriminant = half_b * half_b - a * c;
+		if (discriminant < 0) return false;
+		float sqrtd = std::sqrt(discriminant);
+		float root = (-half_b - sqrtd) / a;
+		if (root < 0) {
+			root = (-half_b + sqrtd) / a;
+			if (root < 0) return false;
+		}
+		hitDistance = root;
+		return true;
+	}
+
+	bool boxLane(const objectSoA& soa, unsigned int i, const glm::vec3& origin, const glm::vec3& direction, float& hitDistance) {
+		glm::vec3 position(soa.positionX()[i], soa.positionY()[i], soa.positionZ()[i]);
+		glm::vec3 scale(soa.scaleX()[i], soa.scaleY()[i], soa.scaleZ()[i]);
+		glm::vec3 t0s = (position - scale / 2.0f - origin) / direction;
+		glm::vec3 t1s = (position + scale / 2.0f - origin) / direction;
+		glm::vec3 tsmaller = glm::min(t0s, t1s);
+		glm::vec3 tbigger = glm::max(t0s, t1s);
+
+		float t1 = std::max(-BOX_FAR, std::max(tsmaller.x, std::max(tsmaller.y, tsmaller.z)));
+		float t2 = std::min(BOX_FAR, std::min(tbigger.x, std::min(tbigger.y, tbigger.z)));
+		hitDistance = t1;
+		if (t1 < 0) hitDistance = t2;
+		return ((t1 >= 0 || t2 >= 0) && t1 <= t2);
+	}
+
+	int closestHitScalar(const objectSoA& soa, unsigned int first, unsigned int count, const glm::vec3& origin, const glm::vec3& direction, float& tMax) {
+		int closest = -1;
+		float hitDistance;
+		for (unsigned int i = first; i < first + count; i++) {
+			int type = soa.type()[i];
+			bool hit = (type == SPHERE && sphereLane(soa, i, origin, direction, hitDistance)) || (type == CUBE && boxLane(soa, i, origin, direction, hitDistance));
+			if (hit && hitDistance < tMax) {
+				tMax = hitDistance;
+				closest = (int)i;
+			}
+		}
+		return closest;
+	}
+
+	bool anyHitScalar(const objectSoA& soa, unsigned int first, unsigned int count, const glm::vec3& origin, const glm::vec3& direction, float tMax) {
+		float hitDistance;
+		for (unsigned int i = first; i < first + count; i++) {
+			int type = soa.type()[i];
+			bool hit = (type == SPHERE && sphereLane(soa, i, origin, direction, hitDistance)) || (type == CUBE && boxLane(soa, i, origin, direction, hitDistance));
+			if (hit && hitDistance < tMax) return true;
+		}
+		return false;
+	}
+
+	// the same slab test as bvh::intersectBounds, ray by ray
+	unsigned int packetBoundsScalar(const float boxMin[3], const float boxMax[3], const simd::rayPacket& p) {
+		unsigned int mask = 0;
+		for (unsigned int i = 0; i < SIMD_PACKET_SIZE; i++) {
+			glm::vec3 origin(p.ox[i], p.oy[i], p.oz[i]);
+			glm::vec3 invDir(p.ix[i], p.iy[i], p.iz[i]);
+			glm::vec3 t0 = (glm::vec3(boxMin[0], boxMin[1], boxMin[2]) - origin) * invDir;
+			glm::vec3 t1 = (glm::vec3(boxMax[0], boxMax[1], boxMax[2]) - origin) * invDir;
+			glm::vec3 tsmaller = glm::min(t0, t1);
+			glm::vec3 tbigger = glm::max(t0, t1);
+
+			float tNear = std::max(std::max(tsmaller.x, tsmaller.y), std::max(tsmaller.z, 0.0f));
+			float tFar = std::min(std::min(tbigger.x, tbigger.y), std::min(tbigger.z, p.tMax[i]));
+			mask |= (tNear <= tFar ? 1u : 0u) << i;
+		}
+		return mask;
+	}
+
+#ifdef SIMD_X86
+	// the ray broadcast into every lane once per call
+	struct raySSE4 {
+		__m128 ox, oy, oz;
+		__m128 dx, dy, dz;
+		__m128 a;
+	};
+
+	struct rayAVX2 {
+		__m256 ox, oy, oz;
+		__m256 dx, dy, dz;
+		__m256 a;
+	};
+
+	// tests lanes [i, i + 4) and returns the mask of lanes that hit nearer than tMax (and are before end), distances go in t
+	// operand order on the min/max calls is picked so nan handling matches glm::min/max and std::min/max in the scalar path
+	TARGET_SSE4 inline __m128 testSSE4(const objectSoA& soa, unsigned int i, __m128i end, const raySSE4& r, __m128 tMax, __m128& t) {
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 half = _mm_set1_ps(0.5f);
+
+		__m128 px = _mm_loadu_ps(soa.positionX() + i), py = _mm_loadu_ps(soa.positionY() + i), pz = _mm_loadu_ps(soa.positionZ() + i);
+		__m128 sx = _mm_loadu_ps(soa.scaleX() + i), sy = _mm_loadu_ps(soa.scaleY() + i), sz = _mm_loadu_ps(soa.scaleZ() + i);
+		__m128i type = _mm_loadu_si128((const __m128i*)(soa.type() + i));
+		__m128i lane = _mm_add_epi32(_mm_set1_epi32((int)i), _mm_setr_epi32(0, 1, 2, 3));
+		__m128 inRange = _mm_castsi128_ps(_mm_cmplt_epi32(lane, end));
+
+		// spheres
+		__m128 rx = _mm_sub_ps(r.ox, px), ry = _mm_sub_ps(r.oy, py), rz = _mm_sub_ps(r.oz, pz);
+		__m128 halfB = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, r.dx), _mm_mul_ps(ry, r.dy)), _mm_mul_ps(rz, r.dz));
+		__m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)), _mm_mul_ps(rz, rz)), _mm_mul_ps(sx, sx));
+		__m128 discriminant = _mm_sub_ps(_mm_mul_ps(halfB, halfB), _mm_mul_ps(r.a, c));
+		__m128 sqrtd = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+		__m128 nearRoot = _mm_div_ps(_mm_sub_ps(_mm_sub_ps(zero, halfB), sqrtd), r.a);
+		__m128 farRoot = _mm_div_ps(_mm_add_ps(_mm_sub_ps(zero, halfB), sqrtd), r.a);
+		__m128 sphereT = _mm_blendv_ps(nearRoot, farRoot, _mm_cmplt_ps(nearRoot, zero));
+		__m128 sphereHit = _mm_and_ps(_mm_cmpge_ps(discriminant, zero), _mm_cmpge_ps(sphereT, zero));
+
+		// boxes
+		__m128 hx = _mm_mul_ps(sx, half), hy = _mm_mul_ps(sy, half), hz = _mm_mul_ps(sz, half);
+		__m128 t0x = _mm_div_ps(_mm_sub_ps(_mm_sub_ps(px, hx), r.ox), r.dx);
+		__m128 t0y = _mm_div_ps(_mm_sub_ps(_mm_sub_ps(py, hy), r.oy), r.dy);
+		__m128 t0z = _mm_div_ps(_mm_sub_ps(_mm_sub_ps(pz, hz), r.oz), r.dz);
+		__m128 t1x = _mm_div_ps(_mm_sub_ps(_mm_add_ps(px, hx), r.ox), r.dx);
+		__m128 t1y = _mm_div_ps(_mm_sub_ps(_mm_add_ps(py, hy), r.oy), r.dy);
+		__m128 t1z = _mm_div_ps(_mm_sub_ps(_mm_add_ps(pz, hz), r.oz), r.dz);
+		__m128 t1 = _mm_max_ps(_mm_max_ps(_mm_max_ps(_mm_min_ps(t1z, t0z), _mm_min_ps(t1y, t0y)), _mm_min_ps(t1x, t0x)), _mm_set1_ps(-BOX_FAR));
+		__m128 t2 = _mm_min_ps(_mm_min_ps(_mm_min_ps(_mm_max_ps(t1z, t0z), _mm_max_ps(t1y, t0y)), _mm_max_ps(t1x, t0x)), _mm_set1_ps(BOX_FAR));
+		__m128 boxT = _mm_blendv_ps(t1, t2, _mm_cmplt_ps(t1, zero));
+		__m128 boxHit = _mm_and_ps(_mm_or_ps(_mm_cmpge_ps(t1, zero), _mm_cmpge_ps(t2, zero)), _mm_cmple_ps(t1, t2));
+
+		__m128 isSphere = _mm_castsi128_ps(_mm_cmpeq_epi32(type, _mm_set1_epi32(SPHERE)));
+		__m128 isBox = _mm_castsi128_ps(_mm_cmpeq_epi32(type, _mm_set1_epi32(CUBE)));
+		t = _mm_blendv_ps(boxT, sphereT, isSphere);
+		__m128 hit = _mm_or_ps(_mm_and_ps(isSphere, sphereHit), _mm_and_ps(isBox, boxHit));
+		return _mm_and_ps(_mm_and_ps(hit, inRange), _mm_cmplt_ps(t, tMax));
+	}
+
+	TARGET_AVX2 inline __m256 testAVX2(const objectSoA& soa, unsigned int i, __m256i end, const rayAVX2& r, __m256 tMax, __m256& t) {
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 half = _mm256_set1_ps(0.5f);
+
+		__m256 px = _mm256_loadu_ps(soa.positionX() + i), py = _mm256_loadu_ps(soa.positionY() + i), pz = _mm256_loadu_ps(soa.positionZ() + i);
+		__m256 sx = _mm256_loadu_ps(soa.scaleX() + i), sy = _mm256_loadu_ps(soa.scaleY() + i), sz = _mm256_loadu_ps(soa.scaleZ() + i);
+		__m256i type = _mm256_loadu_si256((const __m256i*)(soa.type() + i));
+		__m256i lane = _mm256_add_epi32(_mm256_set1_epi32((int)i), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		__m256 inRange = _mm256_castsi256_ps(_mm256_cmpgt_epi32(end, lane));
+
+		// spheres
+		__m256 rx = _mm256_sub_ps(r.ox, px), ry = _mm256_sub_ps(r.oy, py), rz = _mm256_sub_ps(r.oz, pz);
+		__m256 halfB = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rx, r.dx), _mm256_mul_ps(ry, r.dy)), _mm256_mul_ps(rz, r.dz));
+		__m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rx, rx), _mm256_mul_ps(ry, ry)), _mm256_mul_ps(rz, rz)), _mm256_mul_ps(sx, sx));
+		__m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(halfB, halfB), _mm256_mul_ps(r.a, c));
+		__m256 sqrtd = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+		__m256 nearRoot = _mm256_div_ps(_mm256_sub_ps(_mm256_sub_ps(zero, halfB), sqrtd), r.a);
+		__m256 farRoot = _mm256_div_ps(_mm256_add_ps(_mm256_sub_ps(zero, halfB), sqrtd), r.a);
+		__m256 sphereT = _mm256_blendv_ps(nearRoot, farRoot, _mm256_cmp_ps(nearRoot, zero, _CMP_LT_OQ));
+		__m256 sphereHit = _mm256_and_ps(_mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ), _mm256_cmp_ps(sphereT, zero, _CMP_GE_OQ));
+
+		// boxes
+		__m256 hx = _mm256_mul_ps(sx, half), hy = _mm256_mul_ps(sy, half), hz = _mm256_mul_ps(sz, half);
+		__m256 t0x = _mm256_div_ps(_mm256_sub_ps(_mm256_sub_ps(px, hx), r.ox), r.dx);
+		__m256 t0y = _mm256_div_ps(_mm256_sub_ps(_mm256_sub_ps(py, hy), r.oy), r.dy);
+		__m256 t0z = _mm256_div_ps(_mm256_sub_ps(_mm256_sub_ps(pz, hz), r.oz), r.dz);
+		__m256 t1x = _mm256_div_ps(_mm256_sub_ps(_mm256_add_ps(px, hx), r.ox), r.dx);
+		__m256 t1y = _mm256_div_ps(_mm256_sub_ps(_mm256_add_ps(py, hy), r.oy), r.dy);
+		__m256 t1z = _mm256_div_ps(_mm256_sub_ps(_mm256_add_ps(pz, hz), r.oz), r.dz);
+		__m256 t1 = _mm256_max_ps(_mm256_max_ps(_mm256_max_ps(_mm256_min_ps(t1z, t0z), _mm256_min_ps(t1y, t0y)), _mm256_min_ps(t1x, t0x)), _mm256_set1_ps(-BOX_FAR));
+		__m256 t2 = _mm256_min_ps(_mm256_min_ps(_mm256_min_ps(_mm256_max_ps(t1z, t0z), _mm256_max_ps(t1y, t0y)), _mm256_max_ps(t1x, t0x)), _mm256_set1_ps(BOX_FAR));
+		__m256 boxT = _mm256_blendv_ps(t1, t2, _mm256_cmp_ps(t1, zero, _CMP_LT_OQ));
+		__m256 boxHit = _mm256_and_ps(_mm256_or_ps(_mm256_cmp_ps(t1, zero, _CMP_GE_OQ), _mm256_cmp_ps(t2, zero, _CMP_GE_OQ)), _mm256_cmp_ps(t1, t2, _CMP_LE_OQ));
+
+		__m256 isSphere = _mm256_castsi256_ps(_mm256_cmpeq_epi32(type, _mm256_set1_epi32(SPHERE)));
+		__m256 isBox = _mm256_castsi256_ps(_mm256_cmpeq_epi32(type, _mm256_set1_epi32(CUBE)));
+		t = _mm256_blendv_ps(boxT, sphereT, isSphere);
+		__m256 hit = _mm256_or_ps(_mm256_and_ps(isSphere, sphereHit), _mm256_and_ps(isBox, boxHit));
+		return _mm256_and_ps(_mm256_and_ps(hit, inRange), _mm256_cmp_ps(t, tMax, _CMP_LT_OQ));
+	}
+
+	TARGET_SSE4 inline raySSE4 broadcastSSE4(const glm::vec3& origin, const glm::vec3& direction) {
+		return {
+			_mm_set1_ps(origin.x), _mm_set1_ps(origin.y), _mm_set1_ps(origin.z),
+			_mm_set1_ps(direction.x), _mm_set1_ps(direction.y), _mm_set1_ps(direction.z),
+			_mm_set1_ps(glm::dot(direction, direction))
+		};
+	}
+
+	TARGET_AVX2 inline rayAVX2 broadcastAVX2(const glm::vec3& origin, const glm::vec3& direction) {
+		return {
+			_mm256_set1_ps(origin.x), _mm256_set1_ps(origin.y), _mm256_set1_ps(origin.z),
+			_mm256_set1_ps(direction.x), _mm256_set1_ps(direction.y), _mm256_set1_ps(direction.z),
+			_mm256_set1_ps(glm::dot(direction, direction))
+		};
+	}
+
+	TARGET_SSE4 int closestHitSSE4(const objectSoA& soa, unsigned int first, unsigned int count, const glm::vec3& origin, const glm::vec3& direction, float& tMax) {
+		raySSE4 r = broadcastSSE4(origin, direction);
+		__m128i end = _mm_set1_epi32((int)(first + count));
+
+		int closest = -1;
+		for (unsigned int i = first; i < first + count; i += 4) {
+			__m128 t;
+			__m128 hit = testSSE4(soa, i, end, r, _mm_set1_ps(tMax), t);
+			if (_mm_movemask_ps(hit) == 0) continue;
+
+			// horizontal min, then the first lane holding it
+			__m128 candidates = _mm_blendv_ps(_mm_set1_ps(std::numeric_limits<float>::infinity()), t, hit);
+			__m128 minimum = _mm_min_ps(candidates, _mm_shuffle_ps(candidates, candidates, _MM_SHUFFLE(2, 3, 0, 1)));
+			minimum = _mm_min_ps(minimum, _mm_shuffle_ps(minimum, minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+			int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmpeq_ps(candidates, minimum), hit));
+
+			int bit = 0;
+			while (!(mask & (1 << bit))) bit++;
+			tMax = _mm_cvtss_f32(minimum);
+			closest = (int)i + bit;
+		}
+		return closest;
+	}
+
+	TARGET_SSE4 bool anyHitSSE4(const objectSoA& soa, unsigned int first, unsigned int count, const glm::vec3& origin, const glm::vec3& direction, float tMax) {
+		raySSE4 r = broadcastSSE4(origin, direction);
+		__m128i end = _mm_set1_epi32((int)(first + count));
+		__m128 maxDistance = _mm_set1_ps(tMax);
+
+		for (unsigned int i = first; i < first + count; i += 4) {
+			__m128 t;
+			if (_mm_movemask_ps(testSSE4(soa, i, end, r, maxDistance, t))) return true;
+		}
+		return false;
+	}
+
+	// four rays of a packet from lane i on, the operands are ordered like in testSSE4 so nans come out the same
+	TARGET_SSE4 inline int packetBoundsSSE4Half(const float boxMin[3], const float boxMax[3], const simd::rayPacket& p, unsigned int i) {
+		__m128 ox = _mm_loadu_ps(p.ox + i), oy = _mm_loadu_ps(p.oy + i), oz = _mm_loadu_ps(p.oz + i);
+		__m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxMin[0]), ox), _mm_loadu_ps(p.ix + i));
+		__m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxMin[1]), oy), _mm_loadu_ps(p.iy + i));
+		__m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxMin[2]), oz), _mm_loadu_ps(p.iz + i));
+		__m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxMax[0]), ox), _mm_loadu_ps(p.ix + i));
+		__m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxMax[1]), oy), _mm_loadu_ps(p.iy + i));
+		__m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(boxMax[2]), oz), _mm_loadu_ps(p.iz + i));
+		__m128 nearX = _mm_min_ps(t1x, t0x), nearY = _mm_min_ps(t1y, t0y), nearZ = _mm_min_ps(t1z, t0z);
+		__m128 farX = _mm_max_ps(t1x, t0x), farY = _mm_max_ps(t1y, t0y), farZ = _mm_max_ps(t1z, t0z);
+		__m128 tNear = _mm_max_ps(_mm_max_ps(_mm_setzero_ps(), nearZ), _mm_max_ps(nearY, nearX));
+		__m128 tFar = _mm_min_ps(_mm_min_ps(_mm_loadu_ps(p.tMax + i), farZ), _mm_min_ps(farY, farX));
+		return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+	}
+
+	TARGET_SSE4 unsigned int packetBoundsSSE4(const float boxMin[3], const float boxMax[3], const simd::rayPacket& p) {
+		return (unsigned int)(packetBoundsSSE4Half(boxMin, boxMax, p, 0) | packetBoundsSSE4Half(boxMin, boxMax, p, 4) << 4);
+	}
+
+	TARGET_AVX2 int closestHitAVX2(const objectSoA& soa, unsigned int first, unsigned int count, const glm::vec3& origin, const glm::vec3& direction, float& tMax) {
+		rayAVX2 r = broadcastAVX2(origin, direction);
+		__m256i end = _mm256_set1_epi32((int)(first + count));
+
+		int closest = -1;
+		for (unsigned int i = first; i < first + count; i += 8) {
+			__m256 t;
+			__m256 hit = testAVX2(soa, i, end, r, _mm256_set1_ps(tMax), t);
+			if (_mm256_movemask_ps(hit) == 0) continue;
+
+			// horizontal min, then the first lane holding it
+			__m256 candidates = _mm256_blendv_ps(_mm256_set1_ps(std::numeric_limits<float>::infinity()), t, hit);
+			__m256 minimum = _mm256_min_ps(candidates, _mm256_permute_ps(candidates, _MM_SHUFFLE(2, 3, 0, 1)));
+			minimum = _mm256_min_ps(minimum, _mm256_permute_ps(minimum, _MM_SHUFFLE(1, 0, 3, 2)));
+			minimum = _mm256_min_ps(minimum, _mm256_permute2f128_ps(minimum, minimum, 0x01));
+			int mask = _mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(candidates, minimum, _CMP_EQ_OQ), hit));
+
+			int bit = 0;
+			while (!(mask & (1 << bit))) bit++;
+			tMax = _mm256_cvtss_f32(minimum);
+			closest = (int)i + bit;
+		}
+		return closest;
+	}
+
+	TARGET_AVX2 bool anyHitAVX2(const objectSoA& soa, unsigned int first, unsigned int count, const glm::vec3& origin, const glm::vec3& direction, float tMax) {
+		rayAVX2 r = broadcastAVX2(origin, direction);
+		__m256i end = _mm256_set1_epi32((int)(first + count));
+		__m256 maxDistance = _mm256_set1_ps(tMax);
+
+		for (unsigned int i = first; i < first + count; i += 8) {
+			__m256 t;
+			if (_mm256_movemask_ps(testAVX2(soa, i, end, r, maxDistance, t))) return true;
+		}
+		return false;
+	}
+
+	TARGET_AVX2 unsigned int packetBoundsAVX2(const float boxMin[3], const float boxMax[3], const simd::rayPacket& p) {
+		__m256 ox = _mm256_loadu_ps(p.ox), oy = _mm256_loadu_ps(p.oy), oz = _mm256_loadu_ps(p.oz);
+		__m256 t0x = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(boxMin[0]), ox), _mm256_loadu_ps(p.ix));
+		__m256 t0y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(boxMin[1]), oy), _mm256_loadu_ps(p.iy));
+		__m256 t0z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(boxMin[2]), oz), _mm256_loadu_ps(p.iz));
+		__m256 t1x = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(boxMax[0]), ox), _mm256_loadu_ps(p.ix));
+		__m256 t1y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(boxMax[1]), oy), _mm256_loadu_ps(p.iy));
+		__m256 t1z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(boxMax[2]), oz), _mm256_loadu_ps(p.iz));
+		__m256 nearX = _mm256_min_ps(t1x, t0x), nearY = _mm256_min_ps(t1y, t0y), nearZ = _mm256_min_ps(t1z, t0z);
+		__m256 farX = _mm256_max_ps(t1x, t0x), farY = _mm256_max_ps(t1y, t0y), farZ = _mm256_max_ps(t1z, t0z);
+		__m256 tNear = _mm256_max_ps(_mm256_max_ps(_mm256_setzero_ps(), nearZ), _mm256_max_ps(nearY, nearX));
+		__m256 tFar = _mm256_min_ps(_mm256_min_ps(_mm256_loadu_ps(p.tMax), farZ), _mm256_min_ps(farY, farX));
+		return (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+	}
+#endif
+
+	simd::level currentLevel = simd::level::SCALAR;
+
+	simd::level pick(simd::level requested) {
+		simd::level supported = simd::detect();
+		simd::level l = requested > supported ? supported : requested;
+		currentLevel = l;
+		switch (l) {
+#ifdef SIMD_X86
+			case simd::level::AVX2:
+				simd::closestHit = closestHitAVX2;
+				simd::anyHit = anyHitAVX2;
+				simd::packetBounds = packetBoundsAVX2;
+				break;
+			case simd::level::SSE4:
+				simd::closestHit = closestHitSSE4;
+				simd::anyHit = anyHitSSE4;
+				simd::packetBounds = packetBoundsSSE4;
+				break;
+#endif
+			default:
+				simd::closestHit = closestHitScalar;
+				simd::anyHit = anyHitScalar;
+				simd::packetBounds = packetBoundsScalar;
+				break;
+		}
+		return l;
+	}
+}
+
+namespace simd {
+	closestHitFunc closestHit = closestHitScalar;
+	anyHitFunc anyHit = anyHitScalar;
+	packetBoundsFunc packetBounds = packetBoundsScalar;
+
+	// cpuid for sse4.1 / avx2, avx2 also needs the os to save the ymm registers
+	level detect() {
+#if defined(SIMD_X86) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		__cpuid(info, 1);
+		bool sse41 = (info[2] & (1 << 19)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (maxLeaf >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6) {
+			__cpuidex(info, 7, 0);
+			if (info[1] & (1 << 5)) return level::AVX2;
+		}
+		return sse41 ? level::SSE4 : level::SCALAR;
+#elif defined(SIMD_X86)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) return level::AVX2;
+		if (__builtin_cpu_supports("sse4.1")) return level::SSE4;
+		return level::SCALAR;
+#else
+		return level::SCALAR;
+#endif
+	}
+
+	level select(level requested) {
+		return pick(requested);
+	}
+
+	level getLevel() {
+		return currentLevel;
+	}
+
+	unsigned int getWidth() {
+		switch (currentLevel) {
+			case level::AVX2: return 8;
+			case level::SSE4: return 4;
+			default: return 1;
+		}
+	}
+
+	const char* getName(level l) {
+		switch (l) {
+			case level::AVX2: return "avx2";
+			case level::SSE4: return "sse4";
+			default: return "scalar";
+		}
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#define SIMD_PACKET_SIZE 8 // rays in a rayPacket, one avx2 register or two sse4 ones
+
+class objectSoA;
+
+// vectorized ray vs sphere/box tests over objectSoA lanes, 4 lanes per instruction on sse4 and 8 on avx2
+// the instruction set is picked at runtime, the scalar kernel is the reference the others have to match
+namespace simd {
+	enum class level {
+		SCALAR = 0,
+		SSE4 = 1,
+		AVX2 = 2
+	};
+
+	// closest hit among lanes [first, first + count) that's nearer than tMax, returns the lane (or -1) and shrinks tMax to the hit
+	typedef int (*closestHitFunc)(const objectSoA& soa, unsigned int first, unsigned int count, const glm::vec3& origin, const glm::vec3& direction, float& tMax);
+
+	// true as soon as any lane in [first, first + count) hits nearer than tMax, for shadow rays
+	typedef bool (*anyHitFunc)(const objectSoA& soa, unsigned int first, unsigned int count, const glm::vec3& origin, const glm::vec3& direction, float tMax);
+
+	// up to SIMD_PACKET_SIZE rays laid out by component. lanes without a ray keep a tMax below 0 so they never enter anything
+	struct rayPacket {
+		float ox[SIMD_PACKET_SIZE], oy[SIMD_PACKET_SIZE], oz[SIMD_PACKET_SIZE];
+		float ix[SIMD_PACKET_SIZE], iy[SIMD_PACKET_SIZE], iz[SIMD_PACKET_SIZE]; // 1 / direction
+		float tMax[SIMD_PACKET_SIZE];
+	};
+
+	// bvh::intersectBounds for every ray of the packet against one box, bit i is set when ray i enters it before its tMax
+	typedef unsigned int (*packetBoundsFunc)(const float boxMin[3], const float boxMax[3], const rayPacket& packet);
+
+	extern closestHitFunc closestHit;
+	extern anyHitFunc anyHit;
+	extern packetBoundsFunc packetBounds;
+
+	level detect();
+	level select(level requested); // clamps to what the cpu supports and returns what was picked
+	level getLevel();
+	unsigned int getWidth();
+	const char* getName(level l);
+}
@@ -0,0 +1,177 @@
+#include "tileScheduler.h"
+
+#include <algorithm>
+
+namespace {
+	typedef std::chrono::steady_clock steadyClock;
+
+	inline double secondsSince(steadyClock::time_point start) {
+		return std::chrono::duration<double>(steadyClock::now() - start).count();
+	}
+}
+
+tileScheduler::tileScheduler(unsigned int threadCount, int tileSize)
+	: m_threadCount(0), m_tileSize(tileSize), m_generation(0), m_runningWorkers(0), m_stopping(false), m_renderTile(nullptr) {
+	setThreadCount(threadCount);
+	setTileSize(tileSize);
+}
+
+tileScheduler::~tileScheduler() {
+	stopWorkers();
+}
+
+void tileScheduler::setThreadCount(unsigned int threadCount) {
+	if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+	stopWorkers();
+	m_threadCount = threadCount;
+
+	m_queues.clear();
+	for (unsigned int i = 0; i < m_threadCount; i++) {
+		m_queues.push_back(std::unique_ptr<workerQueue>(new workerQueue()));
+	}
+	m_busy.assign(m_threadCount, 0.0);
+	m_idle.assign(m_threadCount, 0.0);
+	m_finished.assign(m_threadCount, 0.0);
+	resetStats();
+
+	for (unsigned int i = 1; i < m_threadCount; i++) {
+		m_workers.emplace_back(&tileScheduler::workerLoop, this, i, m_generation);
+	}
+}
+
+void tileScheduler::stopWorkers() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	for (std::thread& worker : m_workers) {
+		worker.join();
+	}
+	m_workers.clear();
+	m_stopping = false;
+}
+
+void tileScheduler::setTileSize(int tileSize) {
+	m_tileSize = std::max(1, tileSize);
+}
+
+void tileScheduler::resetStats() {
+	m_stats.assign(m_threadCount, threadStats());
+}
+
+// the owner takes from the back, which is the tile next to the one it just finished
+bool tileScheduler::popLocal(unsigned int thread, tile& t) {
+	workerQueue& queue = *m_queues[thread];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+	if (queue.tiles.empty()) return false;
+	t = queue.tiles.back();
+	queue.tiles.pop_back();
+	return true;
+}
+
+// thieves take from the front, the far end of the victim's range
+bool tileScheduler::steal(unsigned int thread, tile& t) {
+	for (unsigned int offset = 1; offset < m_threadCount; offset++) {
+		workerQueue& victim = *m_queues[(thread + offset) % m_threadCount];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.tiles.empty()) continue;
+		t = victim.tiles.front();
+		victim.tiles.pop_front();
+		return true;
+	}
+	return false;
+}
+
+void tileScheduler::work(unsigned int thread) {
+	const std::function<void(const tile&, unsigned int)>& renderTile = *m_renderTile;
+	double& busy = m_busy[thread];
+	double& idle = m_idle[thread];
+	threadStats& stats = m_stats[thread];
+	tile t;
+	while (true) {
+		steadyClock::time_point searchStart = steadyClock::now();
+		bool stolen = false;
+		if (!popLocal(thread, t)) {
+			// nothing gets queued while a frame is running, so once every deque is empty we're done
+			if (!steal(thread, t)) {
+				idle += secondsSince(searchStart);
+				return;
+			}
+			stolen = true;
+		}
+		idle += secondsSince(searchStart);
+
+		steadyClock::time_point renderStart = steadyClock::now();
+		renderTile(t, thread);
+		busy += secondsSince(renderStart);
+
+		stats.tilesRendered++;
+		if (stolen) stats.tilesStolen++;
+	}
+}
+
+// parked on m_wake between passes, generation is the last pass this worker saw so it doesn't run one twice
+void tileScheduler::workerLoop(unsigned int thread, unsigned int generation) {
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&]() { return m_stopping || m_generation != generation; });
+			if (m_stopping) return;
+			generation = m_generation;
+		}
+
+		work(thread);
+		m_finished[thread] = secondsSince(m_passStart);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (--m_runningWorkers == 0) m_done.notify_one();
+	}
+}
+
+void tileScheduler::run(int width, int height, const std::function<void(const tile&, unsigned int)>& renderTile) {
+	std::vector<tile> tiles;
+	for (int y = 0; y < height; y += m_tileSize) {
+		for (int x = 0; x < width; x += m_tileSize) {
+			tiles.push_back({ x, y, std::min(m_tileSize, width - x), std::min(m_tileSize, height - y) });
+		}
+	}
+
+	// every thread starts with one contiguous block of the frame, stealing evens out whatever that gets wrong
+	unsigned int tileCount = (unsigned int)tiles.size();
+	unsigned int perThread = (tileCount + m_threadCount - 1) / m_threadCount;
+	for (unsigned int i = 0; i < m_threadCount; i++) {
+		unsigned int first = std::min(tileCount, i * perThread);
+		unsigned int last = std::min(tileCount, first + perThread);
+		m_queues[i]->tiles.assign(tiles.begin() + first, tiles.begin() + last);
+	}
+
+	std::fill(m_busy.begin(), m_busy.end(), 0.0);
+	std::fill(m_idle.begin(), m_idle.end(), 0.0);
+	std::fill(m_finished.begin(), m_finished.end(), 0.0);
+
+	// the mutex hands the queues and renderTile over to the workers, and their results back once they're done
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_renderTile = &renderTile;
+		m_passStart = steadyClock::now();
+		m_runningWorkers = (unsigned int)m_workers.size();
+		m_generation++;
+	}
+	m_wake.notify_all();
+
+	work(0);
+	m_finished[0] = secondsSince(m_passStart);
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_done.wait(lock, [&]() { return m_runningWorkers == 0; });
+		m_renderTile = nullptr;
+	}
+
+	// time between a thread running out of work and the frame finishing is idle time too
+	double total = secondsSince(m_passStart);
+	for (unsigned int i = 0; i < m_threadCount; i++) {
+		m_stats[i].busySeconds += m_busy[i];
+		m_stats[i].idleSeconds += m_idle[i] + (total - m_finished[i]);
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct tile {
+	int x, y;
+	int width, height;
+};
+
+struct threadStats {
+	double busySeconds; // inside renderTile
+	double idleSeconds; // looking for work or waiting on the other threads to finish
+	unsigned int tilesRendered;
+	unsigned int tilesStolen;
+};
+
+// splits the frame into tiles and renders them on a set of threads that each own a deque
+// a thread works through its own deque from the back and steals from the front of the others once it runs dry,
+// so a thread stuck on glass heavy tiles gets help instead of everyone else sitting idle.
+// the threads stay parked between passes, the caller of run is thread 0 and the rest are started once by setThreadCount
+class tileScheduler {
+private:
+	struct workerQueue {
+		std::mutex mutex;
+		std::deque<tile> tiles;
+	};
+
+	unsigned int m_threadCount;
+	int m_tileSize;
+	std::vector<std::unique_ptr<workerQueue>> m_queues;
+	std::vector<threadStats> m_stats;
+
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex; // guards everything below that the workers wait on
+	std::condition_variable m_wake; // a new pass or shutting down
+	std::condition_variable m_done; // the last worker finished its part of the pass
+	unsigned int m_generation; // bumped by every run, a worker goes again when it's not the one it last saw
+	unsigned int m_runningWorkers;
+	bool m_stopping;
+	const std::function<void(const tile&, unsigned int)>* m_renderTile; // only valid while a run is going
+	std::chrono::steady_clock::time_point m_passStart;
+	std::vector<double> m_busy, m_idle, m_finished; // this pass, per thread
+
+	bool popLocal(unsigned int thread, tile& t);
+	bool steal(unsigned int thread, tile& t);
+	void work(unsigned int thread);
+	void workerLoop(unsigned int thread, unsigned int generation);
+	void stopWorkers();
+public:
+	tileScheduler(unsigned int threadCount = 0, int tileSize = 32);
+	~tileScheduler();
+
+	tileScheduler(const tileScheduler&) = delete;
+	tileScheduler& operator=(const tileScheduler&) = delete;
+
+	// renders every tile of a width x height frame, renderTile(tile, threadIndex) runs concurrently on all threads
+	void run(int width, int height, const std::function<void(const tile&, unsigned int)>& renderTile);
+
+	void setThreadCount(unsigned int threadCount); // not while a run is going
+	void setTileSize(int tileSize);
+	void resetStats();
+
+	inline unsigned int getThreadCount() const { return m_threadCount; }
+	inline int getTileSize() const { return m_tileSize; }
+	inline const std::vector<threadStats>& getStats() const { return m_stats; }
+};
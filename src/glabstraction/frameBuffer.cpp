@@ -15,6 +15,7 @@ frameBuffer::frameBuffer() : m_rendererID(0), screenTexture(0) {
 
 frameBuffer::~frameBuffer() {
 	call(glDeleteFramebuffers(1, &m_rendererID));
+	call(glDeleteTextures(1, &screenTexture));
 }
 
 bool frameBuffer::checkStatus() const {
@@ -30,4 +31,22 @@ void frameBuffer::bind() const {
 
 void frameBuffer::unbind() const {
 	call(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-}
\ No newline at end of file
+}
+
+void frameBuffer::bindTexture(unsigned int slot) const {
+	call(glActiveTexture(GL_TEXTURE0 + slot));
+	call(glBindTexture(GL_TEXTURE_2D, screenTexture));
+}
+// alpha counts the samples in each pixel like the direct pass divides by, leaves texture unit 0 bound to this
+void frameBuffer::resolve(std::vector<float>& output) const {
+	size_t pixelCount = (size_t)scene::screenWidth * scene::screenHeight;
+	std::vector<float> rgba(pixelCount * 4);
+	bindTexture(0);
+	call(glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, rgba.data()));
+
+	output.resize(pixelCount * 3);
+	for (size_t i = 0; i < pixelCount; i++) {
+		float samples = rgba[i * 4 + 3] > 1.0f ? rgba[i * 4 + 3] : 1.0f;
+		for (int c = 0; c < 3; c++) output[i * 3 + c] = rgba[i * 4 + c] / samples;
+	}
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <vector>
+
 #include "../scene.h"
 
 #include "../renderer.h"
@@ -16,4 +18,8 @@ public:
 	bool checkStatus() const;
 	void bind() const;
 	void unbind() const;
+	void bindTexture(unsigned int slot = 0) const; // the color attachment, for reading it in another pass
+	void resolve(std::vector<float>& output) const; // reads the accumulation back as rgb averages, same as cpuRenderer::resolve
+
+	inline unsigned int getTexture() const { return screenTexture; }
 };
\ No newline at end of file
@@ -1,39 +1,295 @@
 #include "shader.h"
 
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <utime.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <sstream>
 #include <string>
 
 #include "../renderer.h"
 
-shader::shader() : m_rendererID(0) {
+namespace {
+    // asked once, the first time a program gets created
+    bool parallelCompile() {
+        static bool supported = [] {
+            if (GLEW_ARB_parallel_shader_compile) {
+                call(glMaxShaderCompilerThreadsARB(0xffffffff));
+            }
+            else if (GLEW_KHR_parallel_shader_compile) {
+                call(glMaxShaderCompilerThreadsKHR(0xffffffff));
+            }
+            else {
+                return false;
+            }
+            return true;
+        }();
+        return supported;
+    }
+
+    // appends the lines of a file to lines with every #include "file" (relative to the including file) replaced by
+    // that file's lines. a file only gets included once, like everything has a #pragma once
+    bool readWithIncludes(const std::string& filepath, std::vector<std::string>& included, std::vector<std::string>& lines) {
+        for (const std::string& path : included) {
+            if (path == filepath) return true;
+        }
+        std::ifstream stream(filepath);
+        if (!stream) {
+            std::cout << "Failed to open shader file '" << filepath << "'!" << std::endl;
+            return false;
+        }
+        included.push_back(filepath);
+
+        std::string directory = filepath.substr(0, filepath.find_last_of("/\\") + 1);
+        std::string line;
+        while (getline(stream, line)) {
+            size_t include = line.find("#include");
+            size_t open = line.find('"', include);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (include != std::string::npos && close != std::string::npos && line.find("//") > include) {
+                readWithIncludes(directory + line.substr(open + 1, close - open - 1), included, lines);
+            }
+            else {
+                lines.push_back(line);
+            }
+        }
+        return true;
+    }
+
+    // program binaries only load on the driver that made them, so its name goes into every cache key
+    const char* binaryCacheDirectory = "shadercache";
+    const long long binaryCacheLimit = 64ll << 20; // bytes, past this the binaries used longest ago get deleted
+
+    const size_t variantLimit = 8; // programs kept per shader, past this the one selected longest ago gets deleted
+
+    // 0 when the driver can't hand out program binaries at all
+    int programBinaryFormats() {
+        static int formats = -1;
+        if (formats == -1) {
+            call(glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats));
+        }
+        return formats;
+    }
+
+    // fnv-1a, unlike std::hash it's the same from one run to the next
+    unsigned long long hashText(const std::string& text, unsigned long long hash = 14695981039346656037ull) {
+        for (char c : text) {
+            hash ^= (unsigned char)c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    std::string driverString() {
+        static std::string driver;
+        if (driver.empty()) {
+            call(const char* vendor = (const char*)glGetString(GL_VENDOR));
+            call(const char* renderer = (const char*)glGetString(GL_RENDERER));
+            call(const char* version = (const char*)glGetString(GL_VERSION));
+            driver = std::string(vendor ? vendor : "") + "|" + (renderer ? renderer : "") + "|" + (version ? version : "");
+        }
+        return driver;
+    }
+
+    std::string binaryCachePath(unsigned long long key) {
+        std::stringstream path;
+        path << binaryCacheDirectory << "/" << std::hex << key << ".bin";
+        return path.str();
+    }
+
+    // every file ahead of the binary, the driver hash lets the pruning find binaries no driver here can load anymore
+    struct binaryHeader {
+        unsigned int format;
+        unsigned int padding;
+        unsigned long long driver;
+    };
+
+    std::vector<std::string> binaryCacheFiles() {
+        std::vector<std::string> files;
+#ifdef _WIN32
+        _finddata_t entry;
+        intptr_t handle = _findfirst((std::string(binaryCacheDirectory) + "/*.bin").c_str(), &entry);
+        if (handle == -1) return files;
+        do {
+            files.push_back(std::string(binaryCacheDirectory) + "/" + entry.name);
+        } while (_findnext(handle, &entry) == 0);
+        _findclose(handle);
+#else
+        DIR* directory = opendir(binaryCacheDirectory);
+        if (!directory) return files;
+        while (dirent* entry = readdir(directory)) {
+            std::string name = entry->d_name;
+            if (name.size() > 4 && name.compare(name.size() - 4, 4, ".bin") == 0) files.push_back(std::string(binaryCacheDirectory) + "/" + name);
+        }
+        closedir(directory);
+#endif
+        return files;
+    }
+
+    // binaries from another driver go, then the ones used longest ago until the rest fits in binaryCacheLimit.
+    // edited sources and permutations nobody selects anymore are never looked up again, they age out the same way
+    void pruneBinaryCache(unsigned long long driver) {
+        struct cachedBinary {
+            std::string path;
+            long long time;
+            long long size;
+        };
+        std::vector<cachedBinary> binaries;
+        long long totalSize = 0;
+        for (const std::string& path : binaryCacheFiles()) {
+            binaryHeader header = {};
+            std::ifstream file(path, std::ios::binary);
+            file.read((char*)&header, sizeof(header));
+            file.close();
+            struct stat info;
+            if (!file || header.driver != driver || stat(path.c_str(), &info) != 0) {
+                std::remove(path.c_str());
+                continue;
+            }
+            binaries.push_back({ path, (long long)info.st_mtime, (long long)info.st_size });
+            totalSize += info.st_size;
+        }
+
+        std::sort(binaries.begin(), binaries.end(), [](const cachedBinary& a, const cachedBinary& b) { return a.time < b.time; });
+        for (size_t i = 0; i < binaries.size() && totalSize > binaryCacheLimit; i++) {
+            std::remove(binaries[i].path.c_str());
+            totalSize -= binaries[i].size;
+        }
+    }
+
+    // a rejected binary (driver update, corrupt file) just means compiling from source this time
+    bool loadProgramBinary(unsigned int program, unsigned long long key) {
+        if (programBinaryFormats() <= 0) return false;
+        std::string path = binaryCachePath(key);
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+
+        binaryHeader header = {};
+        file.read((char*)&header, sizeof(header));
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!file.good() && !file.eof()) return false;
+        if (binary.empty() || header.driver != hashText(driverString())) return false;
+
+        call(glProgramBinary(program, header.format, binary.data(), (int)binary.size()));
+        int linked;
+        call(glGetProgramiv(program, GL_LINK_STATUS, &linked));
+        if (!linked) {
+            std::cout << "Program binary " << path << " was rejected, compiling from source" << std::endl;
+            return false;
+        }
+        // the modification time is when it was last used, so pruning keeps the ones in use
+#ifdef _WIN32
+        _utime(path.c_str(), nullptr);
+#else
+        utime(path.c_str(), nullptr);
+#endif
+        return true;
+    }
 
+    void saveProgramBinary(unsigned int program, unsigned long long key) {
+        if (programBinaryFormats() <= 0) return;
+        int length = 0;
+        call(glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length));
+        if (length <= 0) return;
+
+        std::vector<char> binary(length);
+        binaryHeader header = { 0, 0, hashText(driverString()) };
+        call(glGetProgramBinary(program, length, &length, &header.format, binary.data()));
+
+#ifdef _WIN32
+        _mkdir(binaryCacheDirectory);
+#else
+        mkdir(binaryCacheDirectory, 0755);
+#endif
+        {
+            std::ofstream file(binaryCachePath(key), std::ios::binary);
+            file.write((const char*)&header, sizeof(header));
+            file.write(binary.data(), length);
+        }
+        pruneBinaryCache(header.driver);
+    }
+
+    // modification time and size mixed together, st_mtime is whole seconds so two saves in one second would look the
+    // same without the size. 0 if the file can't be read right now, editors sometimes delete and rewrite it
+    long long modificationTime(const std::string& filepath) {
+        struct stat info;
+        if (stat(filepath.c_str(), &info) != 0) return 0;
+        return (long long)info.st_mtime * 1000003 + (long long)info.st_size;
+    }
+
+    // #version has to be the first line of a stage, so anything pasted in goes right after it
+    std::string insertAfterVersion(const std::string& stage, const std::string& text) {
+        if (stage.empty() || text.empty()) return stage;
+        size_t versionEnd = stage.find('\n') + 1;
+        return stage.substr(0, versionEnd) + text + stage.substr(versionEnd);
+    }
 }
 
-shader::shader(const std::string& filepath) : m_filepath(filepath), m_rendererID(0) {
-    shaderProgramSource source = parseShader(filepath);
-    m_rendererID = createShader(source.vertexSource, source.fragmentSource);
+shader::shader() : m_rendererID(0), m_type(programType::GRAPHICS), m_genericKey(0), m_activeKey(0), m_reloaded(false), m_uploads(0), m_skippedUploads(0), m_lastUploads(0), m_lastSkippedUploads(0) {
+
+}
+
+// the generic program is compiled right away and waited on, everything after it can compile in the background
+shader::shader(const std::string& filepath, programType type) : m_rendererID(0), m_filepath(filepath), m_type(type), m_reloaded(false), m_uploads(0), m_skippedUploads(0), m_lastUploads(0), m_lastSkippedUploads(0) {
+    m_source = parseShader(filepath, m_files);
+    for (const std::string& file : m_files) m_fileTimes.push_back(modificationTime(file));
+    m_lastWatch = std::chrono::steady_clock::now();
+
+    m_genericKey = std::hash<std::string>()("");
+    m_activeKey = m_genericKey;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    pendingProgram pending = createProgram(m_genericKey, m_source, "");
+    m_rendererID = finishProgram(pending);
+    m_variants[m_genericKey] = m_rendererID;
+    m_variantOrder.push_back(m_genericKey);
+
+    // startup time either way, to compare a cold start against a cache hit
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << (pending.cached ? "Loaded " : "Compiled ") << filepath << (type == programType::COMPUTE ? " (compute)" : "")
+        << (pending.cached ? " from the binary cache in " : " in ") << milliseconds << " ms" << std::endl;
 }
 
 shader::~shader() {
-    call(glDeleteProgram(m_rendererID));
+    for (const pendingProgram& pending : m_pending) {
+        deletePending(pending);
+    }
+    for (const std::pair<const size_t, unsigned int>& variant : m_variants) {
+        if (variant.second) {
+            call(glDeleteProgram(variant.second));
+        }
+    }
 }
 
-// Read a shader file and split it up into a vertex and fragment shader
-shaderProgramSource shader::parseShader(const std::string& filepath) {
-    std::ifstream stream(filepath);
+// Read a shader file and split it up into a vertex, fragment and compute shader
+// files gets every file that was read, the shader file first
+shaderProgramSource shader::parseShader(const std::string& filepath, std::vector<std::string>& files) {
+    std::vector<std::string> lines;
+    files.clear();
+    readWithIncludes(filepath, files, lines);
 
     enum class shaderType {
         NONE = -1,
         VERTEX = 0,
-        FRAGMENT = 1
+        FRAGMENT = 1,
+        COMMON = 2,
+        COMPUTE = 3
     };
 
-    std::string line;
-    std::stringstream ss[2];
+    std::stringstream ss[4];
     shaderType type = shaderType::NONE;
-    while (getline(stream, line)) {
+    for (const std::string& line : lines) {
         if (line.find("#shader") != std::string::npos) {
             if (line.find("vertex") != std::string::npos) {
                 type = shaderType::VERTEX;
@@ -41,6 +297,15 @@ shaderProgramSource shader::parseShader(const std::string& filepath) {
             else if (line.find("fragment") != std::string::npos) {
                 type = shaderType::FRAGMENT;
             }
+            else if (line.find("common") != std::string::npos) {
+                type = shaderType::COMMON;
+            }
+            else if (line.find("compute") != std::string::npos) {
+                type = shaderType::COMPUTE;
+            }
+        }
+        else if (type == shaderType::NONE) {
+            continue;
         }
         else if (line.find("//") == std::string::npos) {
             ss[(int)type] << line << '\n';
@@ -50,16 +315,20 @@ shaderProgramSource shader::parseShader(const std::string& filepath) {
         }
     }
 
-    return { ss[0].str(), ss[1].str() };
+    std::string common = ss[(int)shaderType::COMMON].str();
+    return { ss[(int)shaderType::VERTEX].str(), insertAfterVersion(ss[(int)shaderType::FRAGMENT].str(), common), insertAfterVersion(ss[(int)shaderType::COMPUTE].str(), common) };
 }
 
+// only hands the source over, checkShader is what waits for the result
 unsigned int shader::compileShader(unsigned int type, const std::string& source) {
-    // Compile shader
     call(unsigned int id = glCreateShader(type));
     const char* src = source.c_str();
     call(glShaderSource(id, 1, &src, nullptr));
     call(glCompileShader(id));
+    return id;
+}
 
+bool shader::checkShader(unsigned int id, unsigned int type, std::string& errors) {
     int result;
     call(glGetShaderiv(id, GL_COMPILE_STATUS, &result));
     // Handle errors
@@ -68,31 +337,255 @@ unsigned int shader::compileShader(unsigned int type, const std::string& source)
         call(glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length));
         char* message = (char*)alloca(length * sizeof(char)); // virgin malloc vs chad alloca
         call(glGetShaderInfoLog(id, length, &length, message));
-        std::cout << "Failed to compile " << (type == GL_VERTEX_SHADER ? "vertex" : "fragment") << " shader!" << std::endl;
-        std::cout << message << std::endl;
-        call(glDeleteShader(id));
+        std::string error = std::string("Failed to compile ") + (type == GL_VERTEX_SHADER ? "vertex" : type == GL_FRAGMENT_SHADER ? "fragment" : "compute") + " shader!\n" + message;
+        std::cout << error << std::endl;
+        errors += error;
+        return false;
+    }
+    return true;
+}
+
+// compiles and links one permutation without asking for any results, so a driver with parallel shader compile
+// can do it on its own threads
+// a program binary cached for the same sources on the same driver skips all of it
+shader::pendingProgram shader::createProgram(size_t key, const shaderProgramSource& source, const std::string& defines) {
+    std::vector<std::pair<unsigned int, std::string>> stages;
+    if (m_type == programType::COMPUTE) {
+        stages.push_back({ GL_COMPUTE_SHADER, insertAfterVersion(source.computeSource, defines) });
+    }
+    else {
+        stages.push_back({ GL_VERTEX_SHADER, insertAfterVersion(source.vertexSource, defines) });
+        stages.push_back({ GL_FRAGMENT_SHADER, insertAfterVersion(source.fragmentSource, defines) });
+    }
+
+    pendingProgram pending = { key, 0, { 0, 0 }, false, false, hashText(driverString()) };
+    for (const std::pair<unsigned int, std::string>& stage : stages) {
+        pending.cacheKey = hashText(stage.second, pending.cacheKey);
+    }
+
+    call(pending.program = glCreateProgram());
+    if (loadProgramBinary(pending.program, pending.cacheKey)) {
+        pending.cached = true;
+        return pending;
+    }
+    // a rejected binary leaves the program in a failed link state, start from a clean one
+    call(glDeleteProgram(pending.program));
+    call(pending.program = glCreateProgram());
+    call(glProgramParameteri(pending.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+
+    for (size_t i = 0; i < stages.size(); i++) {
+        pending.stages[i] = compileShader(stages[i].first, stages[i].second);
+    }
+
+    for (unsigned int stage : pending.stages) {
+        if (stage) {
+            call(glAttachShader(pending.program, stage));
+        }
+    }
+    call(glLinkProgram(pending.program));
+    return pending;
+}
+
+// without parallel shader compile there's no way to ask, finishProgram just blocks until it's done
+bool shader::isReady(const pendingProgram& pending) const {
+    if (!parallelCompile()) return true;
+    int done;
+    call(glGetProgramiv(pending.program, GL_COMPLETION_STATUS_ARB, &done));
+    return done != 0;
+}
+
+// prints whatever went wrong, returns the program or 0 if it didn't compile or link
+unsigned int shader::finishProgram(const pendingProgram& pending) {
+    std::string errors;
+    bool compiled = true;
+    for (unsigned int stage : pending.stages) {
+        if (!stage) continue;
+        int type;
+        call(glGetShaderiv(stage, GL_SHADER_TYPE, &type));
+        compiled = checkShader(stage, type, errors) && compiled;
+        call(glDetachShader(pending.program, stage));
+        call(glDeleteShader(stage));
+    }
+
+    int linked;
+    call(glGetProgramiv(pending.program, GL_LINK_STATUS, &linked));
+    if (compiled && !linked) {
+        int length;
+        call(glGetProgramiv(pending.program, GL_INFO_LOG_LENGTH, &length));
+        char* message = (char*)alloca(length * sizeof(char));
+        call(glGetProgramInfoLog(pending.program, length, &length, message));
+        errors = "Failed to link " + m_filepath + "!\n" + message;
+        std::cout << errors << std::endl;
+    }
+    if (!compiled || !linked) {
+        m_errors = errors;
+        call(glDeleteProgram(pending.program));
         return 0;
     }
+    if (!pending.cached) saveProgramBinary(pending.program, pending.cacheKey);
+    return pending.program;
+}
 
-    return id;
+void shader::deletePending(const pendingProgram& pending) {
+    for (unsigned int stage : pending.stages) {
+        if (stage) {
+            call(glDeleteShader(stage));
+        }
+    }
+    call(glDeleteProgram(pending.program));
+}
+
+// finishes whatever the driver is done with, a reload that linked throws every permutation of the old source away
+void shader::collectPending() {
+    for (size_t i = 0; i < m_pending.size();) {
+        if (!isReady(m_pending[i])) {
+            i++;
+            continue;
+        }
+        pendingProgram pending = m_pending[i];
+        m_pending.erase(m_pending.begin() + i);
+        unsigned int program = finishProgram(pending);
+        if (!pending.reload) {
+            m_variants[pending.key] = program;
+            continue;
+        }
+        if (!program) {
+            std::cout << "Reloading " << m_filepath << " failed, keeping the last program" << std::endl;
+            continue;
+        }
+
+        for (const pendingProgram& stale : m_pending) {
+            deletePending(stale);
+        }
+        m_pending.clear();
+        for (const std::pair<const size_t, unsigned int>& variant : m_variants) {
+            if (variant.second) {
+                call(glDeleteProgram(variant.second));
+            }
+        }
+        m_variants.clear();
+        m_variantOrder.clear();
+
+        m_source = m_reloadSource;
+        m_variants[m_genericKey] = program;
+        m_variantOrder.push_back(m_genericKey);
+        m_activeKey = m_genericKey;
+        m_rendererID = program;
+        replayUniforms();
+        m_reloaded = true;
+        m_errors.clear();
+        std::cout << "Reloaded " << m_filepath << std::endl;
+        return;
+    }
+}
+
+bool shader::reloadIfChanged() {
+    collectPending();
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - m_lastWatch >= std::chrono::milliseconds(500)) {
+        m_lastWatch = now;
+        bool changed = false;
+        for (size_t i = 0; i < m_files.size(); i++) {
+            long long time = modificationTime(m_files[i]);
+            changed = changed || (time != 0 && time != m_fileTimes[i]);
+        }
+
+        if (changed) {
+            // a reload still compiling is already out of date
+            for (size_t i = 0; i < m_pending.size();) {
+                if (m_pending[i].reload) {
+                    deletePending(m_pending[i]);
+                    m_pending.erase(m_pending.begin() + i);
+                }
+                else i++;
+            }
+
+            m_reloadSource = parseShader(m_filepath, m_files);
+            m_fileTimes.clear();
+            for (const std::string& file : m_files) m_fileTimes.push_back(modificationTime(file));
+
+            pendingProgram pending = createProgram(m_genericKey, m_reloadSource, "");
+            pending.reload = true;
+            m_pending.push_back(pending);
+        }
+    }
+
+    bool reloaded = m_reloaded;
+    m_reloaded = false;
+    return reloaded;
 }
 
-unsigned int shader::createShader(const std::string& vertexShader, const std::string& fragShader) {
-    // Initialize an empty shader and compile vertex and fragment shaders
-    call(unsigned int program = glCreateProgram());
-    unsigned int vs = compileShader(GL_VERTEX_SHADER, vertexShader);
-    unsigned int fs = compileShader(GL_FRAGMENT_SHADER, fragShader);
+void shader::selectVariant(const shaderDefines& defines) {
+    std::string text;
+    for (const std::pair<std::string, int>& define : defines) {
+        text += "#define " + define.first + " " + std::to_string(define.second) + "\n";
+    }
+    size_t key = std::hash<std::string>()(text);
 
-    // Use the shaders
-    call(glAttachShader(program, vs));
-    call(glAttachShader(program, fs));
-    call(glLinkProgram(program));
-    call(glValidateProgram(program));
+    collectPending();
 
-    call(glDeleteShader(vs));
-    call(glDeleteShader(fs));
+    std::unordered_map<size_t, unsigned int>::const_iterator it = m_variants.find(key);
+    if (it == m_variants.end() && m_pending.empty()) {
+        m_pending.push_back(createProgram(key, m_source, text));
+        m_variants[key] = 0;
+        it = m_variants.find(key);
+    }
+    if (it != m_variants.end()) {
+        m_variantOrder.erase(std::remove(m_variantOrder.begin(), m_variantOrder.end(), key), m_variantOrder.end());
+        m_variantOrder.push_back(key);
+    }
 
-    return program;
+    // a failed or unfinished permutation falls back to the generic one, which is always right
+    activate(it != m_variants.end() && it->second ? key : m_genericKey);
+    evictVariants();
+}
+
+// the feature defines only take a handful of values, but a scene toggling between many of them shouldn't keep every
+// program it ever made. the generic one, the active one and the one compiling stay no matter how old they are
+void shader::evictVariants() {
+    for (size_t i = 0; m_variants.size() > variantLimit && i < m_variantOrder.size();) {
+        size_t key = m_variantOrder[i];
+        bool compiling = false;
+        for (const pendingProgram& pending : m_pending) compiling = compiling || pending.key == key;
+        if (key == m_genericKey || key == m_activeKey || compiling) {
+            i++;
+            continue;
+        }
+        unsigned int program = m_variants[key];
+        if (program) {
+            call(glDeleteProgram(program));
+        }
+        m_variants.erase(key);
+        m_variantOrder.erase(m_variantOrder.begin() + i);
+    }
+}
+
+void shader::activate(size_t key) {
+    if (key == m_activeKey) return;
+    m_activeKey = key;
+    m_rendererID = m_variants[key];
+    replayUniforms();
+}
+
+// the uniform table is by name, so after a switch every location gets looked up again and every value
+// the old program had gets sent to the new one
+void shader::replayUniforms() {
+    for (uniformSlot& slot : m_uniforms) {
+        call(slot.location = glGetUniformLocation(m_rendererID, slot.name.c_str()));
+        if (slot.location == -1 || slot.type == 0) continue;
+
+        const int* ints = (const int*)slot.value;
+        switch (slot.type) {
+        case GL_INT: call(glProgramUniform1iv(m_rendererID, slot.location, 1, ints)); break;
+        case GL_INT_VEC2: call(glProgramUniform2iv(m_rendererID, slot.location, 1, ints)); break;
+        case GL_FLOAT: call(glProgramUniform1fv(m_rendererID, slot.location, 1, slot.value)); break;
+        case GL_FLOAT_VEC3: call(glProgramUniform3fv(m_rendererID, slot.location, 1, slot.value)); break;
+        case GL_FLOAT_VEC4: call(glProgramUniform4fv(m_rendererID, slot.location, 1, slot.value)); break;
+        case GL_FLOAT_MAT4: call(glProgramUniformMatrix4fv(m_rendererID, slot.location, 1, GL_FALSE, slot.value)); break;
+        }
+        m_uploads++;
+    }
 }
 
 void shader::bind() const {
@@ -103,76 +596,120 @@ void shader::unbind() const {
     call(glUseProgram(0));
 }
 
+// the handle versions only call gl when the value is different from the last one sent
+// glProgramUniform so the program doesn't have to be bound, there can be more than one of them now
+void shader::setUniform1i(uniformHandle handle, int value) {
+    if (uniformSlot* slot = updateCache(handle, GL_INT, &value, sizeof(value))) {
+        call(glProgramUniform1i(m_rendererID, slot->location, value));
+    }
+}
+
+void shader::setUniform1f(uniformHandle handle, float value) {
+    if (uniformSlot* slot = updateCache(handle, GL_FLOAT, &value, sizeof(value))) {
+        call(glProgramUniform1f(m_rendererID, slot->location, value));
+    }
+}
+
+void shader::setUniform2i(uniformHandle handle, int v0, int v1) {
+    int value[2] = { v0, v1 };
+    if (uniformSlot* slot = updateCache(handle, GL_INT_VEC2, value, sizeof(value))) {
+        call(glProgramUniform2i(m_rendererID, slot->location, v0, v1));
+    }
+}
+
+void shader::setUniform3f(uniformHandle handle, float v0, float v1, float v2) {
+    float value[3] = { v0, v1, v2 };
+    if (uniformSlot* slot = updateCache(handle, GL_FLOAT_VEC3, value, sizeof(value))) {
+        call(glProgramUniform3f(m_rendererID, slot->location, v0, v1, v2));
+    }
+}
+
+void shader::setUniform4f(uniformHandle handle, float v0, float v1, float v2, float v3) {
+    float value[4] = { v0, v1, v2, v3 };
+    if (uniformSlot* slot = updateCache(handle, GL_FLOAT_VEC4, value, sizeof(value))) {
+        call(glProgramUniform4f(m_rendererID, slot->location, v0, v1, v2, v3));
+    }
+}
+
+void shader::setUniformMat4f(uniformHandle handle, const glm::mat4& value) {
+    if (uniformSlot* slot = updateCache(handle, GL_FLOAT_MAT4, &value[0][0], sizeof(value))) {
+        call(glProgramUniformMatrix4fv(m_rendererID, slot->location, 1, GL_FALSE, &value[0][0]));
+    }
+}
+
 void shader::setUniform1i(const std::string& name, int value) {
-    call(glUniform1i(getUniformLocation(name), value));
+    setUniform1i(getUniform(name), value);
 }
 
 void shader::setUniform1f(const std::string& name, float value) {
-    call(glUniform1f(getUniformLocation(name), value));
+    setUniform1f(getUniform(name), value);
 }
 
-void shader::setUniform3f(const std::string& name, float v0, float v1, float v2) {
+void shader::setUniform2i(const std::string& name, int v0, int v1) {
+    setUniform2i(getUniform(name), v0, v1);
+}
 
-    call(glUniform3f(getUniformLocation(name), v0, v1, v2));
+void shader::setUniform3f(const std::string& name, float v0, float v1, float v2) {
+    setUniform3f(getUniform(name), v0, v1, v2);
 }
 
 void shader::setUniform4f(const std::string& name, float v0, float v1, float v2, float v3) {
-    
-    call(glUniform4f(getUniformLocation(name), v0, v1, v2, v3));
+    setUniform4f(getUniform(name), v0, v1, v2, v3);
 }
 
 void shader::setUniformMat4f(const std::string& name, glm::mat4 value) {
-    call(glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &value[0][0]));
-}
-
-void shader::setUniformObject(scene::object object, unsigned int index) {
-    call(glUniform1ui(getUniformLocation(std::string("u_objects[").append(std::to_string(index)).append("].type")), object.type));
-    call(glUniform3f(getUniformLocation(std::string("u_objects[").append(std::to_string(index)).append("].position")), object.position[0], object.position[1], object.position[2]));
-    call(glUniform3f(getUniformLocation(std::string("u_objects[").append(std::to_string(index)).append("].scale")), object.scale[0], object.scale[1], object.scale[2]));
-    // Material
-    call(glUniform3f(getUniformLocation(std::string("u_objects[").append(std::to_string(index)).append("].material.albedo")), scene::materials[object.mat].albedo[0], scene::materials[object.mat].albedo[1], scene::materials[object.mat].albedo[2]));
-    call(glUniform3f(getUniformLocation(std::string("u_objects[").append(std::to_string(index)).append("].material.emission")), scene::materials[object.mat].emission[0], scene::materials[object.mat].emission[1], scene::materials[object.mat].emission[2]));
-    call(glUniform3f(getUniformLocation(std::string("u_objects[").append(std::to_string(index)).append("].material.specular")), scene::materials[object.mat].specular[0], scene::materials[object.mat].specular[1], scene::materials[object.mat].specular[2]));
-    call(glUniform1f(getUniformLocation(std::string("u_objects[").append(std::to_string(index)).append("].material.emissionStrength")), scene::materials[object.mat].emissionStrength));
-    call(glUniform1f(getUniformLocation(std::string("u_objects[").append(std::to_string(index)).append("].material.roughness")), scene::materials[object.mat].roughness));
-    call(glUniform1f(getUniformLocation(std::string("u_objects[").append(std::to_string(index)).append("].material.specularHighlight")), scene::materials[object.mat].specularHighlight));
-    call(glUniform1f(getUniformLocation(std::string("u_objects[").append(std::to_string(index)).append("].material.specularExponent")), scene::materials[object.mat].specularExponent));
-    call(glUniform1i(getUniformLocation(std::string("u_objects[").append(std::to_string(index)).append("].material.transparent")), scene::materials[object.mat].transparent));
-    call(glUniform1f(getUniformLocation(std::string("u_objects[").append(std::to_string(index)).append("].material.refractiveIndex")), scene::materials[object.mat].refractiveIndex));
-}
-
-void shader::setUniformLight(scene::pointLight light, unsigned int index) {
-    call(glUniform3f(getUniformLocation(std::string("u_lights[").append(std::to_string(index)).append("].position")), light.position[0], light.position[1], light.position[2]));
-    call(glUniform1f(getUniformLocation(std::string("u_lights[").append(std::to_string(index)).append("].radius")), light.radius));
-    call(glUniform3f(getUniformLocation(std::string("u_lights[").append(std::to_string(index)).append("].color")), light.color[0], light.color[1], light.color[2]));
-    call(glUniform1f(getUniformLocation(std::string("u_lights[").append(std::to_string(index)).append("].power")), light.power));
-    call(glUniform1f(getUniformLocation(std::string("u_lights[").append(std::to_string(index)).append("].reach")), light.reach));
-}
-
-void shader::setUniformMaterial(const std::string& name, scene::material material) {
-    call(glUniform3f(getUniformLocation(std::string(name).append(".albedo")), material.albedo[0], material.albedo[1], material.albedo[2]));
-    call(glUniform3f(getUniformLocation(std::string(name).append(".emission")), material.emission[0], material.emission[1], material.emission[2]));
-    call(glUniform3f(getUniformLocation(std::string(name).append(".specular")), material.specular[0], material.specular[1], material.specular[2]));
-    call(glUniform1f(getUniformLocation(std::string(name).append(".emissionStrength")), material.emissionStrength));
-    call(glUniform1f(getUniformLocation(std::string(name).append(".roughness")), material.roughness));
-    call(glUniform1f(getUniformLocation(std::string(name).append(".specularHighlight")), material.specularHighlight));
-    call(glUniform1f(getUniformLocation(std::string(name).append(".specularExponent")), material.specularExponent));
-
-    call(glUniform1i(getUniformLocation(std::string(name).append(".transparent")), material.transparent));
-    call(glUniform1f(getUniformLocation(std::string(name).append(".refractiveIndex")), material.refractiveIndex));
+    setUniformMat4f(getUniform(name), value);
 }
 
-int shader::getUniformLocation(const std::string& name) {
-    if (m_uniformLocationCache.find(name) != m_uniformLocationCache.end()) {
-        return m_uniformLocationCache[name];
+// one slot per name, the location is looked up the first time only
+uniformHandle shader::getUniform(const std::string& name) {
+    std::unordered_map<std::string, int>::const_iterator it = m_uniformIndices.find(name);
+    if (it != m_uniformIndices.end()) {
+        return uniformHandle(it->second);
+    }
+
+    uniformSlot slot;
+    slot.name = name;
+    slot.location = getUniformLocation(name);
+    slot.type = 0;
+    std::memset(slot.value, 0, sizeof(slot.value));
+    m_uniforms.push_back(slot);
+
+    int index = (int)m_uniforms.size() - 1;
+    m_uniformIndices[name] = index;
+    return uniformHandle(index);
+}
+
+void shader::newFrame() {
+    m_lastUploads = m_uploads;
+    m_lastSkippedUploads = m_skippedUploads;
+    m_uploads = 0;
+    m_skippedUploads = 0;
+}
+
+// stores the new value and returns the slot if it has to be uploaded, nullptr if it matches what the program already has
+shader::uniformSlot* shader::updateCache(uniformHandle handle, unsigned int type, const void* value, unsigned int size) {
+    if (!handle.valid() || handle.index >= (int)m_uniforms.size()) return nullptr;
+    uniformSlot& slot = m_uniforms[handle.index];
+
+    if (slot.type == type && std::memcmp(slot.value, value, size) == 0) {
+        if (slot.location != -1) m_skippedUploads++;
+        return nullptr;
     }
 
+    // still cached when this permutation compiled it away, another one might need it after a switch
+    slot.type = type;
+    std::memcpy(slot.value, value, size);
+    if (slot.location == -1) return nullptr;
+    m_uploads++;
+    return &slot;
+}
+
+int shader::getUniformLocation(const std::string& name) {
     call(int location = glGetUniformLocation(m_rendererID, name.c_str()));
     if (location == -1) {
         std::cout << "Warning: uniform '" << name << "' doesn't exist!" << std::endl;
     }
 
-    m_uniformLocationCache[name] = location;
-    
     return location;
-}
\ No newline at end of file
+}
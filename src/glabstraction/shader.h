@@ -2,41 +2,135 @@
 
 #include <glm/glm.hpp>
 
+#include <chrono>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
-#include "../scene.h"
-
+// #shader common is pasted into the fragment and compute stages right after their #version line
 struct shaderProgramSource {
 	std::string vertexSource;
 	std::string fragmentSource;
+	std::string computeSource;
+};
+
+// name and value of every #define a program permutation is compiled with
+typedef std::vector<std::pair<std::string, int>> shaderDefines;
+
+// which stages of the file get linked into the program
+enum class programType {
+	GRAPHICS = 0, // vertex + fragment
+	COMPUTE = 1
+};
+
+// index into a shader's uniform table, resolve it once with getUniform and reuse it every frame
+struct uniformHandle {
+	int index;
+
+	uniformHandle() : index(-1) {}
+	explicit uniformHandle(int index) : index(index) {}
+	inline bool valid() const { return index >= 0; }
 };
 
 class shader {
 private:
-	unsigned int m_rendererID;
+	unsigned int m_rendererID; // whichever permutation is active
 	std::string m_filepath;
-	std::unordered_map<std::string, int> m_uniformLocationCache;
+	programType m_type;
+	shaderProgramSource m_source; // kept around to compile more permutations from
 
-	shaderProgramSource parseShader(const std::string& filepath);
+	// a permutation that was handed to the driver but hasn't been looked at yet
+	struct pendingProgram {
+		size_t key;
+		unsigned int program;
+		unsigned int stages[2];
+		bool reload; // a new generic program from the file on disk, replaces every permutation once it links
+		bool cached; // came out of the binary cache, nothing to compile
+		unsigned long long cacheKey; // hash of the driver and the exact stage sources
+	};
+	// every permutation so far by the hash of its defines, 0 while it compiles or if it failed
+	// the generic one (no defines) is always there, it gets drawn with while the wanted one isn't ready
+	std::unordered_map<size_t, unsigned int> m_variants;
+	std::vector<size_t> m_variantOrder; // the keys of m_variants, the one selected longest ago first
+	std::vector<pendingProgram> m_pending;
+	size_t m_genericKey, m_activeKey;
+
+	// hot reload, the file and everything it includes with the modification times they were read at
+	std::vector<std::string> m_files;
+	std::vector<long long> m_fileTimes;
+	std::chrono::steady_clock::time_point m_lastWatch;
+	shaderProgramSource m_reloadSource; // what the pending reload was compiled from
+	bool m_reloaded;
+	std::string m_errors; // log of the last compile or link that failed, cleared by a reload that works
+	// every uniform set so far with its location and the last value sent, so a repeat of the same value is skipped
+	// the name, type and value are all kept so the table can be replayed onto another program
+	struct uniformSlot {
+		std::string name;
+		int location;
+		unsigned int type; // gl type of the last upload, 0 before the first one
+		float value[16]; // ints are stored bit for bit
+	};
+	std::vector<uniformSlot> m_uniforms;
+	std::unordered_map<std::string, int> m_uniformIndices;
+	unsigned int m_uploads, m_skippedUploads; // this frame
+	unsigned int m_lastUploads, m_lastSkippedUploads;
+
+	shaderProgramSource parseShader(const std::string& filepath, std::vector<std::string>& files);
 	unsigned int compileShader(unsigned int type, const std::string& source);
-	unsigned int createShader(const std::string& vertexShader, const std::string& fragShader);
+	bool checkShader(unsigned int id, unsigned int type, std::string& errors);
+	pendingProgram createProgram(size_t key, const shaderProgramSource& source, const std::string& defines);
+	bool isReady(const pendingProgram& pending) const;
+	unsigned int finishProgram(const pendingProgram& pending);
+	void deletePending(const pendingProgram& pending);
+	void collectPending();
+	void activate(size_t key);
+	void evictVariants();
+	void replayUniforms();
 	int getUniformLocation(const std::string& name);
+	uniformSlot* updateCache(uniformHandle handle, unsigned int type, const void* value, unsigned int size);
 public:
 	shader();
-	shader(const std::string& filepath);
+	shader(const std::string& filepath, programType type = programType::GRAPHICS);
 	~shader();
 
 	void bind() const;
 	void unbind() const;
 
+	inline unsigned int getID() const { return m_rendererID; }
+
+	// call once a frame: switches to the permutation for these defines once it's compiled, the generic program
+	// stands in until then. only one permutation compiles at a time and nothing here waits on the driver when
+	// it has parallel shader compile
+	void selectVariant(const shaderDefines& defines);
+	inline unsigned int getVariantCount() const { return (unsigned int)(m_variants.size() - m_pending.size()); }
+	inline bool isCompiling() const { return !m_pending.empty(); }
+	inline bool isGeneric() const { return m_activeKey == m_genericKey; }
+
+	// looks at the files every half second and recompiles when one changed, the last good program keeps drawing
+	// until the new one links and stays if it doesn't. true on the frame a reloaded program takes over
+	bool reloadIfChanged();
+	inline const std::string& getErrors() const { return m_errors; }
+
+	uniformHandle getUniform(const std::string& name);
+
+	void setUniform1i(uniformHandle handle, int value);
+	void setUniform1f(uniformHandle handle, float value);
+	void setUniform2i(uniformHandle handle, int v0, int v1);
+	void setUniform3f(uniformHandle handle, float v0, float v1, float v2);
+	void setUniform4f(uniformHandle handle, float v0, float v1, float v2, float v3);
+	void setUniformMat4f(uniformHandle handle, const glm::mat4& value);
+
+	// by name for one off uploads, these resolve the handle every call
 	void setUniform1i(const std::string& name, int value);
 	void setUniform1f(const std::string& name, float value);
+	void setUniform2i(const std::string& name, int v0, int v1);
 	void setUniform3f(const std::string& name, float v0, float v1, float v2);
 	void setUniform4f(const std::string& name, float v0, float v1, float v2, float v3);
 	void setUniformMat4f(const std::string& name, glm::mat4 value);
 
-	void setUniformObject(scene::object object, unsigned int index);
-	void setUniformLight(scene::pointLight light, unsigned int index);
-	void setUniformMaterial(const std::string& name, scene::material material);
+	// upload counters, newFrame moves this frame's counts into the last frame ones
+	void newFrame();
+	inline unsigned int getUniformUploads() const { return m_lastUploads; }
+	inline unsigned int getSkippedUniformUploads() const { return m_lastSkippedUploads; }
 };
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "storageBuffer.h"
+
+#include "../renderer.h"
+
+// generate the ssbo, it gets storage the first time data is set
+storageBuffer::storageBuffer(unsigned int binding) : m_rendererID(0), m_binding(binding), m_size(0) {
+    call(glGenBuffers(1, &m_rendererID));
+}
+
+// obvious
+storageBuffer::~storageBuffer() {
+    call(glDeleteBuffers(1, &m_rendererID));
+}
+
+// only reallocates when the data outgrows the buffer, otherwise it's just a sub data upload
+void storageBuffer::setData(const void* data, unsigned int size) {
+    call(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_rendererID));
+    if (size > m_size) {
+        call(glBufferData(GL_SHADER_STORAGE_BUFFER, size, data, GL_DYNAMIC_DRAW));
+        m_size = size;
+        bind();
+    }
+    else if (size > 0) {
+        call(glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data));
+    }
+}
+
+void storageBuffer::setSubData(unsigned int offset, const void* data, unsigned int size) {
+    if (size == 0) return;
+    call(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_rendererID));
+    call(glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size, data));
+}
+
+// grows like setData, the contents are undefined until a shader or clear writes them
+void storageBuffer::allocate(unsigned int size) {
+    if (size <= m_size) return;
+    call(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_rendererID));
+    call(glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW));
+    m_size = size;
+    bind();
+}
+
+// fills the range with the pattern repeated, done on the gpu so nothing has to come from a cpu side copy
+void storageBuffer::clear(unsigned int offset, unsigned int size, const unsigned int pattern[4]) {
+    if (size == 0) return;
+    call(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_rendererID));
+    call(glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_RGBA32UI, offset, size, GL_RGBA_INTEGER, GL_UNSIGNED_INT, pattern));
+}
+
+// bind the ssbo to its binding point
+void storageBuffer::bind() const {
+    call(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_binding, m_rendererID));
+}
+
+void storageBuffer::unbind() const {
+    call(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, m_binding, 0));
+}
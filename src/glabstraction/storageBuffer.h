@@ -0,0 +1,22 @@
+#pragma once
+
+// shader storage buffer (std430) bound to a fixed binding point
+class storageBuffer {
+private:
+	unsigned int m_rendererID;
+	unsigned int m_binding;
+	unsigned int m_size;
+public:
+	storageBuffer(unsigned int binding);
+	~storageBuffer();
+
+	void setData(const void* data, unsigned int size);
+	void setSubData(unsigned int offset, const void* data, unsigned int size);
+	void allocate(unsigned int size); // storage for the shaders to fill, nothing gets uploaded
+	void clear(unsigned int offset, unsigned int size, const unsigned int pattern[4] = nullptr); // size in multiples of 16 bytes, zeros without a pattern
+	void bind() const;
+	void unbind() const;
+
+	inline unsigned int getID() const { return m_rendererID; }
+	inline unsigned int getSize() const { return m_size; }
+};
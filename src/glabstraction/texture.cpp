@@ -1,8 +1,9 @@
 #include "texture.h"
 
+#include "../skyboxDistribution.h"
 #include "../vendor/stb/stb_image.h"
 
-texture::texture(const std::string& path) : m_rendererID(0), m_filePath(path), m_localBuffer(nullptr), m_width(0), m_height(0), m_bpp(0) {
+texture::texture(const std::string& path, skyboxDistribution* distribution, float gamma) : m_rendererID(0), m_filePath(path), m_localBuffer(nullptr), m_width(0), m_height(0), m_bpp(0) {
 	stbi_set_flip_vertically_on_load(1);
 	m_localBuffer = stbi_loadf(path.c_str(), &m_width, &m_height, &m_bpp, 0);
 	
@@ -15,10 +16,25 @@ texture::texture(const std::string& path) : m_rendererID(0), m_filePath(path), m
 	call(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, m_width, m_height, 0, GL_RGB, GL_FLOAT, m_localBuffer));
 	call(glBindTexture(GL_TEXTURE_2D, 0));
 
+	if (distribution)
+		distribution->build(m_localBuffer, m_width, m_height, m_bpp, gamma);
 	if (m_localBuffer)
 		stbi_image_free(m_localBuffer);
 }
 
+texture::texture(int width, int height, const float* data) : m_rendererID(0), m_localBuffer(nullptr), m_width(width), m_height(height), m_bpp(1) {
+	call(glGenTextures(1, &m_rendererID));
+	call(glBindTexture(GL_TEXTURE_2D, m_rendererID));
+
+	call(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+	call(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+	call(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
+	call(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
+
+	call(glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, m_width, m_height, 0, GL_RED, GL_FLOAT, data));
+	call(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
 texture::~texture() {
 	call(glDeleteTextures(1, &m_rendererID));
 }
@@ -2,6 +2,8 @@
 
 #include "../renderer.h"
 
+class skyboxDistribution;
+
 class texture {
 private:
 	unsigned int m_rendererID;
@@ -9,7 +11,9 @@ private:
 	float* m_localBuffer;
 	int m_width, m_height, m_bpp;
 public:
-	texture(const std::string& path);
+	// an hdr image, distribution gets built from its pixels (at that gamma) before they're freed when it's the skybox
+	texture(const std::string& path, skyboxDistribution* distribution = nullptr, float gamma = 1.0f);
+	texture(int width, int height, const float* data); // single channel, nearest and repeating, for lookup tables like blue noise
 	~texture();
 
 	void bind(unsigned int slot = 0) const;
@@ -9,7 +9,7 @@ vertexBuffer::vertexBuffer(const void* data, unsigned int size) {
 }
 
 vertexBuffer::~vertexBuffer() {
-    call(glDeleteBuffers(1, &m_rendererID))
+    call(glDeleteBuffers(1, &m_rendererID));
 }
 
 void vertexBuffer::bind() const {
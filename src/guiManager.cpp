@@ -1,5 +1,7 @@
 #include "guiManager.h"
 
+#include "glabstraction/shader.h"
+
 bool guiManager::show = true;
 bool guiManager::worldModified = false;
 
@@ -67,6 +69,7 @@ void guiManager::objectEdit() {
     ImGui::Spacing();
     
     if (scene::objects[scene::selectedObjectIndex] != prev) {
+        scene::markObject(scene::selectedObjectIndex);
         worldModified = true;
     }
 
@@ -78,7 +81,6 @@ void guiManager::objectEdit() {
     }
 
     ImGui::End();
-    scene::updateObjects();
 }
 
 void guiManager::materialList() {
@@ -94,8 +96,14 @@ void guiManager::materialList() {
     for (unsigned int i = 0; i < scene::materials.size(); i++) {
         if (ImGui::SmallButton(std::string("Material ").append(std::to_string(i)).c_str())) {
             scene::selectedMaterialIndex = i;
-            if (scene::planeSelected) scene::planeMaterial = scene::selectedMaterialIndex;
-            else scene::objects[scene::selectedObjectIndex].mat = scene::selectedMaterialIndex;
+            if (scene::planeSelected) {
+                scene::planeMaterial = scene::selectedMaterialIndex;
+                scene::markProperties(scene::PROPERTY_PLANE_MATERIAL);
+            }
+            else {
+                scene::objects[scene::selectedObjectIndex].mat = scene::selectedMaterialIndex;
+                scene::markObject(scene::selectedObjectIndex);
+            }
             worldModified = true;
             showMaterialEdit = true;
         }
@@ -107,10 +115,16 @@ void guiManager::materialList() {
 void guiManager::materialEdit() {
     // new material
     if (scene::selectedMaterialIndex == -1) {
-        scene::materials.push_back(scene::material());
+        scene::addMaterial(scene::material());
         scene::selectedMaterialIndex = scene::materials.size() - 1;
-        if (scene::planeSelected) scene::planeMaterial = scene::selectedMaterialIndex;
-        else scene::objects[scene::selectedObjectIndex].mat = scene::selectedMaterialIndex;
+        if (scene::planeSelected) {
+            scene::planeMaterial = scene::selectedMaterialIndex;
+            scene::markProperties(scene::PROPERTY_PLANE_MATERIAL);
+        }
+        else {
+            scene::objects[scene::selectedObjectIndex].mat = scene::selectedMaterialIndex;
+            scene::markObject(scene::selectedObjectIndex);
+        }
     }
 
     scene::material prev = scene::materials[scene::selectedMaterialIndex];
@@ -130,6 +144,7 @@ void guiManager::materialEdit() {
     ImGui::InputFloat("Index of Refraction", &scene::materials[scene::selectedMaterialIndex].refractiveIndex);
 
     if (scene::materials[scene::selectedMaterialIndex] != prev) {
+        scene::markMaterial(scene::selectedMaterialIndex);
         worldModified = true;
     }
 
@@ -168,6 +183,7 @@ void guiManager::lightEdit() {
     ImGui::Spacing();
     
     if (scene::lights[scene::selectedLightIndex] != prev) {
+        scene::markLight(scene::selectedLightIndex);
         worldModified = true;
     }
 
@@ -179,7 +195,6 @@ void guiManager::lightEdit() {
     }
 
     ImGui::End();
-    scene::updateLights();
 }
 
 void guiManager::showGUI() {
@@ -195,6 +210,13 @@ void guiManager::render() {
         worldModified = false;
         ImGui::Begin("Ray Tracer");
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        if (scene::currShader) ImGui::Text("Uniform uploads %u (%u skipped as unchanged)", scene::currShader->getUniformUploads(), scene::currShader->getSkippedUniformUploads());
+        if (scene::currShader) ImGui::Text("Shader variants %u, %s%s", scene::currShader->getVariantCount(), scene::currShader->isGeneric() ? "generic" : "specialized", scene::currShader->isCompiling() ? " (compiling)" : "");
+        ImGui::Checkbox("Hot Reload Shaders", &scene::hotReload);
+        // the last program that worked is still drawing, this is why the edit isn't showing up
+        if (scene::currShader && !scene::currShader->getErrors().empty()) {
+            ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "%s", scene::currShader->getErrors().c_str());
+        }
         ImGui::TextColored(ImVec4(1.0f, 0.8f, 1.0f, 1.0f), "Objects");
         ImGui::SameLine();
         if (ImGui::Button("+##obj")) {
@@ -230,7 +252,10 @@ void guiManager::render() {
         
         // plane
         ImGui::Spacing();
-        if (ImGui::Checkbox("Plane Visible", &scene::planeVisible)) worldModified = true;
+        if (ImGui::Checkbox("Plane Visible", &scene::planeVisible)) {
+            scene::markProperties(scene::PROPERTY_PLANE_VISIBLE);
+            worldModified = true;
+        }
         if (ImGui::Button("Plane Material")) {
             scene::planeSelected = true;
             scene::selectedMaterialIndex = scene::planeMaterial;
@@ -239,12 +264,60 @@ void guiManager::render() {
         ImGui::SameLine();
         ImGui::Text(std::string("Material ").append(std::to_string(scene::planeMaterial)).c_str());
 
-        // shadow resolution and other uniform variables
+        // shadow rays per light and other uniform variables
         ImGui::Spacing();
-        if (ImGui::DragInt("Shadow Resolution", &scene::shadowResolution)) worldModified = true;
-        if (ImGui::DragInt("Light Bounces", &scene::lightBounces)) worldModified = true;
-        if (ImGui::DragFloat("Skybox Gamma", &scene::skyboxGamma)) worldModified = true;
-        if (ImGui::DragFloat("Skybox Strength", &scene::skyboxStrength)) worldModified = true;
+        if (ImGui::DragInt("Shadow Rays", &scene::shadowRays, 0.1f, 1, 16)) {
+            scene::markProperties(scene::PROPERTY_SHADOW_RAYS);
+            worldModified = true;
+        }
+        // 0 shades every light with that many shadow rays, otherwise this many lights picked by power with one ray each
+        if (ImGui::DragInt("Light Samples", &scene::lightSamples, 0.1f, 0, 6)) {
+            scene::markProperties(scene::PROPERTY_LIGHT_SAMPLES);
+            worldModified = true;
+        }
+        // lights picked per pixel at the first hit, resampled against the last passes and the neighbours. 0 turns it off.
+        // the sampler has room for 32768 candidates (lightDimension), past 32 more of them stop paying for themselves
+        if (ImGui::DragInt("Reservoir Candidates", &scene::reservoirCandidates, 0.1f, 0, 32)) {
+            scene::markProperties(scene::PROPERTY_RESERVOIR_CANDIDATES);
+            worldModified = true;
+        }
+        if (ImGui::DragInt("Light Bounces", &scene::lightBounces)) {
+            scene::markProperties(scene::PROPERTY_LIGHT_BOUNCES);
+            worldModified = true;
+        }
+        if (ImGui::DragInt("Roulette Depth", &scene::rouletteDepth, 1.0f, 0, 100)) {
+            scene::markProperties(scene::PROPERTY_ROULETTE_DEPTH);
+            worldModified = true;
+        }
+        if (ImGui::Combo("Sampler", &scene::samplingMethod, "Random\0Sobol\0Blue Noise\0")) {
+            scene::markProperties(scene::PROPERTY_SAMPLING_METHOD);
+            worldModified = true;
+        }
+        if (ImGui::InputInt("Seed", &scene::randomSeed)) {
+            scene::markProperties(scene::PROPERTY_RANDOM_SEED);
+            worldModified = true;
+        }
+        if (ImGui::DragFloat("Skybox Gamma", &scene::skyboxGamma)) {
+            scene::markProperties(scene::PROPERTY_SKYBOX_GAMMA);
+            worldModified = true;
+        }
+        if (ImGui::DragFloat("Skybox Strength", &scene::skyboxStrength)) {
+            scene::markProperties(scene::PROPERTY_SKYBOX_STRENGTH);
+            worldModified = true;
+        }
+
+        // more passes per swap trades gui responsiveness for less per sample overhead
+        ImGui::Spacing();
+        ImGui::DragInt("Samples Per Frame", &scene::samplesPerPresent, 0.1f, 1, 64);
+
+        // accumulation pass as a tiled compute dispatch, a budget below the tile count spreads a pass over several frames
+        ImGui::Spacing();
+        if (ImGui::Checkbox("Compute Shader", &scene::computeMode)) worldModified = true;
+        if (scene::computeMode) {
+            if (ImGui::DragInt("Tile Size", &scene::computeTileSize, 8.0f, 8, 4096)) worldModified = true;
+            ImGui::DragInt("Tiles Per Frame", &scene::computeTileBudget, 1.0f, 0, 4096);
+            ImGui::Checkbox("Wavefront", &scene::computeWavefront);
+        }
         ImGui::End();
 
         // everything else here
@@ -7,24 +7,47 @@
 #include "vendor/imgui/imgui_impl_glfw.h"
 #include "vendor/imgui/imgui_impl_opengl3.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <iostream>
-#include <time.h>
+#include <string>
+#include <vector>
 
 #include "renderer.h"
 
 #include "glabstraction/frameBuffer.h"
 #include "glabstraction/indexBuffer.h"
 #include "glabstraction/shader.h"
+#include "glabstraction/storageBuffer.h"
 #include "glabstraction/texture.h"
 #include "glabstraction/vertexArray.h"
 #include "glabstraction/vertexBuffer.h"
 #include "glabstraction/vertexBufferLayout.h"
 
+#include "cpu/cpuRenderer.h"
+#include "cpu/hdrImage.h"
+#include "cpu/simdKernels.h"
+
+#include "blueNoise.h"
+#include "computeRenderer.h"
 #include "guiManager.h"
+#include "rng.h"
 #include "scene.h"
+#include "skyboxDistribution.h"
 
 bool mouseAbsorbed = false;
 
+// what the tracing pass needs every frame, the fragment and compute programs each have their own handles
+struct passUniforms {
+    uniformHandle cameraPos, rotationMatrix, accumulatedPasses, schlickPass;
+
+    passUniforms(shader& program)
+        : cameraPos(program.getUniform("u_cameraPos")), rotationMatrix(program.getUniform("u_rotationMatrix")),
+        accumulatedPasses(program.getUniform("u_accumulatedPasses")), schlickPass(program.getUniform("u_schlickPass")) {}
+};
+
 glm::mat4 rotationMatrix(1);
 
 glm::vec3 cameraPos(0.0f, 1.0f, -1.0f);
@@ -130,9 +153,177 @@ bool handleMovement(GLFWwindow* window, double deltaTime, glm::vec3& cameraPosit
     return moved;
 }
 
-int main(void)
+void printSkyboxStats(const skyboxDistribution& table) {
+    if (table.empty()) {
+        std::cout << "Skybox table: empty, the sky is only sampled by escaping paths" << std::endl;
+        return;
+    }
+    std::cout << "Skybox table: " << table.getWidth() << "x" << table.getHeight() << " cells built in " << table.getBuildSeconds() * 1000.0 << " ms on "
+        << table.getBuildThreads() << " threads" << std::endl;
+}
+
+// scene options the window and --headless both take, so the same render can be made on either side and compared
+// [--sampler random|sobol|bluenoise] [--seed n] [--light-samples n] [--reservoir-candidates n]
+bool parseSceneOption(int argc, char** argv, int& i) {
+    bool hasValue = i + 1 < argc;
+    if (!strcmp(argv[i], "--sampler") && hasValue) {
+        i++;
+        if (!strcmp(argv[i], "random")) scene::samplingMethod = 0;
+        else if (!strcmp(argv[i], "sobol")) scene::samplingMethod = 1;
+        else if (!strcmp(argv[i], "bluenoise")) scene::samplingMethod = 2;
+    }
+    else if (!strcmp(argv[i], "--seed") && hasValue) scene::randomSeed = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--light-samples") && hasValue) scene::lightSamples = atoi(argv[++i]);
+    // the same range as the gui, the packed reservoirs only count that many
+    else if (!strcmp(argv[i], "--reservoir-candidates") && hasValue) scene::reservoirCandidates = std::min(std::max(atoi(argv[++i]), 0), 32);
+    else return false;
+    return true;
+}
+
+// compares two .pfm renders, like a --headless one against a --dump of the gl path. exits with 1 if the rmse is over
+// the tolerance so it can gate a script
+// usage: --compare a.pfm b.pfm [--tolerance t]
+int compareImages(int argc, char** argv) {
+    std::vector<std::string> paths;
+    double tolerance = 0.01;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--compare")) continue;
+        if (!strcmp(argv[i], "--tolerance") && i + 1 < argc) tolerance = atof(argv[++i]);
+        else paths.push_back(argv[i]);
+    }
+    if (paths.size() != 2) {
+        std::cout << "usage: --compare a.pfm b.pfm [--tolerance t]" << std::endl;
+        return -1;
+    }
+
+    hdrImage a(paths[0]), b(paths[1]);
+    if (!a.isLoaded() || !b.isLoaded()) return -1;
+    if (a.getWidth() != b.getWidth() || a.getHeight() != b.getHeight()) {
+        std::cout << "Sizes differ, " << a.getWidth() << "x" << a.getHeight() << " against " << b.getWidth() << "x" << b.getHeight() << std::endl;
+        return 1;
+    }
+
+    size_t count = (size_t)a.getWidth() * a.getHeight() * 3;
+    double squared = 0.0, maxDifference = 0.0, meanA = 0.0, meanB = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        double difference = (double)a.getPixels()[i] - b.getPixels()[i];
+        squared += difference * difference;
+        maxDifference = std::max(maxDifference, std::abs(difference));
+        meanA += a.getPixels()[i];
+        meanB += b.getPixels()[i];
+    }
+    double rmse = std::sqrt(squared / count);
+    std::cout << "rmse " << rmse << ", max difference " << maxDifference << ", means " << meanA / count << " / " << meanB / count << std::endl;
+    if (rmse > tolerance) {
+        std::cout << "Over the tolerance of " << tolerance << std::endl;
+        return 1;
+    }
+    std::cout << "Within the tolerance of " << tolerance << std::endl;
+    return 0;
+}
+
+// renders the default scene on the cpu and writes it to a .pfm, no window or gl context needed
+// usage: --headless [--width w] [--height h] [--passes n] [--threads n] [--tile-size n] [--simd scalar|sse4|avx2] [--mode megakernel|wavefront] [--sort-rays] [--skybox path] [--output path] plus the scene options
+int renderHeadless(int argc, char** argv) {
+    int width = 1280;
+    int height = 720;
+    int passes = 64;
+    unsigned int threads = 0;
+    int tileSize = 32;
+    simd::level simdLevel = simd::detect();
+    renderMode mode = renderMode::MEGAKERNEL;
+    bool sortRays = false;
+    std::string skyboxPath = "res/skyboxes/belfast_sunset_puresky_4k.hdr";
+    std::string outputPath = "render.pfm";
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--width") && hasValue) width = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--height") && hasValue) height = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--passes") && hasValue) passes = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--threads") && hasValue) threads = (unsigned int)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--tile-size") && hasValue) tileSize = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--simd") && hasValue) {
+            i++;
+            if (!strcmp(argv[i], "scalar")) simdLevel = simd::level::SCALAR;
+            else if (!strcmp(argv[i], "sse4")) simdLevel = simd::level::SSE4;
+            else if (!strcmp(argv[i], "avx2")) simdLevel = simd::level::AVX2;
+        }
+        else if (!strcmp(argv[i], "--mode") && hasValue) {
+            i++;
+            if (!strcmp(argv[i], "megakernel")) mode = renderMode::MEGAKERNEL;
+            else if (!strcmp(argv[i], "wavefront")) mode = renderMode::WAVEFRONT;
+        }
+        else if (!strcmp(argv[i], "--sort-rays")) sortRays = true;
+        else if (parseSceneOption(argc, argv, i)) continue;
+        else if (!strcmp(argv[i], "--skybox") && hasValue) skyboxPath = argv[++i];
+        else if (!strcmp(argv[i], "--output") && hasValue) outputPath = argv[++i];
+    }
+
+    scene::screenWidth = width;
+    scene::screenHeight = height;
+    scene::loadDefaultScene();
+    simdLevel = simd::select(simdLevel);
+
+    hdrImage skybox(skyboxPath);
+
+    cpuRenderer renderer(width, height, threads, tileSize);
+    renderer.setSkybox(&skybox);
+    renderer.setMode(mode);
+    renderer.setRaySorting(sortRays);
+    printSkyboxStats(renderer.getSkyboxDistribution());
+
+    glm::mat4 rotation = glm::rotate(glm::rotate(glm::mat4(1), cameraPitch, glm::vec3(1, 0, 0)), cameraYaw, glm::vec3(0, 1, 0));
+    cpuCamera camera = { cameraPos, rotation, (float)width / height };
+
+    std::cout << "Rendering " << width << "x" << height << ", " << passes << " passes on " << renderer.getThreadCount() << " threads (" << simd::getName(simdLevel)
+        << (mode == renderMode::WAVEFRONT ? (sortRays ? ", wavefront, sorted rays" : ", wavefront") : ", megakernel") << ")" << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < passes; i++) {
+        renderer.renderPass(camera);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Finished in " << seconds << "s (" << seconds * 1000.0 / std::max(passes, 1) << " ms/pass)" << std::endl;
+
+    const std::vector<threadStats>& stats = renderer.getScheduler().getStats();
+    for (unsigned int i = 0; i < stats.size(); i++) {
+        std::cout << "  thread " << i << ": busy " << stats[i].busySeconds << "s, idle " << stats[i].idleSeconds << "s, "
+            << stats[i].tilesRendered << " tiles (" << stats[i].tilesStolen << " stolen)" << std::endl;
+    }
+
+    if (!renderer.writePFM(outputPath)) {
+        std::cout << "Failed to write " << outputPath << std::endl;
+        return -1;
+    }
+    std::cout << "Wrote " << outputPath << std::endl;
+    return 0;
+}
+
+// without --headless or --compare it's the window
+// usage: [--width w] [--height h] [--compute] [--wavefront] [--dump path] [--dump-passes n] plus the scene options
+// --dump writes the accumulation as a .pfm once it has dump-passes passes (64 by default) and closes the window
+int main(int argc, char** argv)
 {
-    srand((unsigned)std::time(NULL));
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--headless")) return renderHeadless(argc, argv);
+        if (!strcmp(argv[i], "--compare")) return compareImages(argc, argv);
+    }
+
+    int windowWidth = 0;
+    int windowHeight = 0;
+    std::string dumpPath;
+    int dumpPasses = 64;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (!strcmp(argv[i], "--width") && hasValue) windowWidth = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--height") && hasValue) windowHeight = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--compute")) scene::computeMode = true;
+        else if (!strcmp(argv[i], "--wavefront")) scene::computeMode = scene::computeWavefront = true;
+        else if (!strcmp(argv[i], "--dump") && hasValue) dumpPath = argv[++i];
+        else if (!strcmp(argv[i], "--dump-passes") && hasValue) dumpPasses = atoi(argv[++i]);
+        else parseSceneOption(argc, argv, i);
+    }
+
     GLFWwindow* window;
 
     // Initialize the library
@@ -142,12 +333,16 @@ int main(void)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef _DEBUG
+    // debug contexts send a lot more through the debug output callback
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+#endif
     
     // Create a borderless fullscreen mode window and its OpenGL context
     GLFWmonitor* monitor = glfwGetPrimaryMonitor();
     const GLFWvidmode* mode = glfwGetVideoMode(monitor);
-    scene::screenWidth = mode->width;
-    scene::screenHeight = mode->height;
+    scene::screenWidth = windowWidth > 0 ? windowWidth : mode->width;
+    scene::screenHeight = windowHeight > 0 ? windowHeight : mode->height;
 
     glfwWindowHint(GLFW_RED_BITS, mode->redBits);
     glfwWindowHint(GLFW_GREEN_BITS, mode->greenBits);
@@ -172,6 +367,7 @@ int main(void)
     }
     
     std::cout << glGetString(GL_VERSION) << std::endl;
+    GLEnableDebugOutput();
 
     {
         float viewport[] = {
@@ -186,9 +382,18 @@ int main(void)
             2, 3, 0
         };
 
-        // skybox whatever
-        texture skybox("res/skyboxes/belfast_sunset_puresky_4k.hdr");
+        // skybox whatever, plus the table for sampling it as a light
+        skyboxDistribution skyboxTable;
+        texture skybox("res/skyboxes/belfast_sunset_puresky_4k.hdr", &skyboxTable, scene::skyboxGamma);
+        printSkyboxStats(skyboxTable);
+
+        // blue noise tile for the blue noise sampler
+        blueNoise noise;
+        texture blueNoiseTexture(noise.getSize(), noise.getSize(), noise.getValues());
+
+        // creating a texture binds it to the active unit, so only bind to the real slots once both exist
         skybox.bind(1);
+        blueNoiseTexture.bind(2);
 
         // initialize a vertex array
         vertexArray va;
@@ -203,30 +408,77 @@ int main(void)
         // Generate and bind index buffer
         indexBuffer ib(index_buffer, 6);
 
-        // Use shader
+        // Use shader, the compute program is the same file's #shader compute stage
+        shader computeShader("res/shaders/raytrace.shader", programType::COMPUTE);
         shader shader("res/shaders/raytrace.shader");
         shader.bind();
-        shader.setUniform1f("u_aspectRatio", (float)mode->width / mode->height);
-
-        frameBuffer fb;
-        if (!fb.checkStatus()) {
-            std::cout << "Framebuffer is not complete!" << std::endl;
-            return -1;
+        shader.setUniform1f("u_aspectRatio", (float)scene::screenWidth / scene::screenHeight);
+        computeShader.setUniform1f("u_aspectRatio", (float)scene::screenWidth / scene::screenHeight);
+
+        // everything set every frame is resolved once, the loop only passes handles around
+        passUniforms fragmentPass(shader);
+        passUniforms computePass(computeShader);
+        uniformHandle directPassUniform = shader.getUniform("u_directPass");
+
+        // two accumulation targets, each pass reads the last one and draws into the other
+        frameBuffer accumulation[2];
+        int currentTarget = 0; // the one holding the newest image
+        for (const frameBuffer& target : accumulation) {
+            target.bind();
+            if (!target.checkStatus()) {
+                std::cout << "Framebuffer is not complete!" << std::endl;
+                return -1;
+            }
         }
+        accumulation[0].unbind();
 
         shader.setUniform1i("u_screenTexture", 0);
         shader.setUniform1i("u_skyboxTexture", 1);
-
-        scene::materials.push_back(scene::material());
-        scene::materials.push_back(scene::material({ 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, 0.0f, 1.0f, 0.0f, 0.0f, true, 1.5f));
-        scene::addObject(scene::object(1, { 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f }, 1));
-        scene::addLight(scene::pointLight({ 2.0f, 8.0f, -1.0f }, 2.0f, { 1.0f, 1.0f, 1.0f }, 20.0f, 30.0f));
-
-        scene::currShader = &shader;
+        shader.setUniform1i("u_blueNoiseTexture", 2);
+        computeShader.setUniform1i("u_skyboxTexture", 1);
+        computeShader.setUniform1i("u_blueNoiseTexture", 2);
+        shader.setUniform2i("u_skyboxCells", skyboxTable.getWidth(), skyboxTable.getHeight());
+        computeShader.setUniform2i("u_skyboxCells", skyboxTable.getWidth(), skyboxTable.getHeight());
+
+        // the starting camera, so the first frames match the cpu renderer instead of waiting for mouse input
+        rotationMatrix = glm::rotate(glm::rotate(glm::mat4(1), cameraPitch, glm::vec3(1, 0, 0)), cameraYaw, glm::vec3(0, 1, 0));
+
+        scene::loadDefaultScene();
+
+        storageBuffer bvhNodes(0);
+        storageBuffer bvhIndices(1);
+        storageBuffer objectData(2);
+        storageBuffer lightData(3);
+        storageBuffer materialData(4);
+        storageBuffer lightAliasData(5);
+        storageBuffer emitterData(6);
+        storageBuffer lightBVHNodes(7);
+        storageBuffer lightBVHIndices(8);
+        storageBuffer skyboxAliasData(9);
+        storageBuffer reservoirData(10);
+        // the sky never changes, so its table goes up once here instead of through scene
+        skyboxAliasData.setData(skyboxTable.getEntries().data(), (unsigned int)(skyboxTable.getEntries().size() * sizeof(aliasEntry)));
+
+        // currShader is whichever program does the tracing
+        bool computeMode = scene::computeMode;
+        int computeTileSize = scene::computeTileSize;
+        scene::currShader = computeMode ? &computeShader : &shader;
+        scene::bvhNodeBuffer = &bvhNodes;
+        scene::bvhIndexBuffer = &bvhIndices;
+        scene::objectBuffer = &objectData;
+        scene::lightBuffer = &lightData;
+        scene::materialBuffer = &materialData;
+        scene::lightAliasBuffer = &lightAliasData;
+        scene::emitterBuffer = &emitterData;
+        scene::lightBVHNodeBuffer = &lightBVHNodes;
+        scene::lightBVHIndexBuffer = &lightBVHIndices;
+        scene::reservoirBuffer = &reservoirData;
         scene::updateObjects();
         scene::updateLights();
+        scene::updateMaterials();
 
         renderer renderer;
+        computeRenderer compute(computeShader, accumulation[currentTarget].getTexture(), scene::screenWidth, scene::screenHeight, computeTileSize);
 
         guiManager gui(window);
 
@@ -241,51 +493,116 @@ int main(void)
         // Loop until the user closes the window
         while (!glfwWindowShouldClose(window)) {
             double preTime = glfwGetTime();
+            shader.newFrame();
+            computeShader.newFrame();
             // Poll for and process events
             glfwPollEvents();
             
             if (mouseAbsorbed) {
                 if (handleMovement(window, deltaTime, cameraPos, cameraPitch, cameraYaw, &rotationMatrix)) {
                     refresh = true;
-                    shader.setUniform3f("u_cameraPos", cameraPos.x, cameraPos.y, cameraPos.z);
-                    shader.setUniformMat4f("u_rotationMatrix", rotationMatrix);
                 }
             }
+            // an edited shader keeps drawing with the old program until the new one links, then the image starts over
+            if (scene::hotReload) {
+                if (shader.reloadIfChanged()) refresh = true;
+                if (computeShader.reloadIfChanged()) refresh = true;
+            }
+            // the gui switched programs, the new one has never seen the scene so everything goes up again
+            if (scene::computeMode != computeMode) {
+                computeMode = scene::computeMode;
+                scene::currShader = computeMode ? &computeShader : &shader;
+                scene::markAll();
+                refresh = true;
+            }
+            if (scene::computeWavefront != compute.isWavefront()) {
+                compute.setWavefront(scene::computeWavefront);
+                refresh = true;
+            }
+            if (scene::computeTileSize != computeTileSize) {
+                computeTileSize = scene::computeTileSize;
+                compute.setTileSize(computeTileSize);
+                refresh = true;
+            }
             if (refresh) {
                 accumulatedPasses = 0;
                 schlickPass = 1;
                 increment = true;
                 refresh = false;
-                shader.setUniform1i("u_accumulatedPasses", accumulatedPasses);
+                compute.restart();
+                // reservoirs from before the camera or the scene changed would bleed into the new image
+                call(glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT));
+                scene::clearReservoirs();
             }
             
             // Render here
 
             gui.newFrame();
 
-            shader.setUniform1f("u_time", preTime);
+            // only whatever the gui marked last frame actually gets uploaded
+            scene::updateObjects();
+            scene::updateLights();
+            scene::updateMaterials();
             scene::setProperties();
+            // picks up a permutation that finished compiling or starts the next one, the generic program draws meanwhile
+            scene::currShader->selectVariant(scene::getShaderDefines());
+
+            // unchanged values get skipped by the uniform cache, so these can just go every frame
+            passUniforms& pass = computeMode ? computePass : fragmentPass;
+            scene::currShader->setUniform3f(pass.cameraPos, cameraPos.x, cameraPos.y, cameraPos.z);
+            scene::currShader->setUniformMat4f(pass.rotationMatrix, rotationMatrix);
+
+            // several passes per present, so the swap, the gui and the per frame uniforms are paid once for all of them
+            // a dump stops at exactly dumpPasses so it lines up with a --headless render of the same count
+            for (int sample = 0; sample < std::max(scene::samplesPerPresent, 1) && (dumpPath.empty() || accumulatedPasses < dumpPasses); sample++) {
+                scene::currShader->setUniform1i(pass.accumulatedPasses, accumulatedPasses);
+                scene::currShader->setUniform1f(pass.schlickPass, schlickPass);
+
+                bool passFinished = true;
+                if (computeMode) {
+                    // every pixel only touches itself, so the compute pass can stay in place on the current target
+                    compute.setTarget(accumulation[currentTarget].getTexture());
+                    passFinished = compute.dispatch(scene::computeTileBudget);
+                }
+                else {
+                    accumulation[currentTarget].bindTexture(0);
+                    accumulation[1 - currentTarget].bind();
+                    shader.setUniform1i(directPassUniform, 0);
+                    renderer.draw(va, ib, shader);
+                    // the reservoirs this pass wrote are what the next one reads
+                    if (scene::reservoirCandidates > 0) {
+                        call(glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT));
+                    }
+                    accumulation[1 - currentTarget].unbind();
+                    currentTarget = 1 - currentTarget;
+                }
 
-            shader.setUniform1f("u_schlickPass", schlickPass);
-            if (schlickPass > 0 && increment) {
-                schlickPass -= 0.1f;
-            }
-            else if (schlickPass < 0) {
-                increment = false;
+                // a tiled pass spread over several frames keeps its pass index and schlick value until every tile is in
+                if (passFinished) {
+                    if (schlickPass > 0 && increment) {
+                        schlickPass -= 0.1f;
+                    }
+                    else if (schlickPass < 0) {
+                        increment = false;
+                    }
+
+                    if (!increment) {
+                        schlickPass = rng::uniform((unsigned int)scene::randomSeed, (unsigned int)accumulatedPasses);
+                    }
+                    accumulatedPasses++;
+                }
             }
 
-            if (!increment) {
-                schlickPass = (float)rand() / RAND_MAX;
+            if (!dumpPath.empty() && accumulatedPasses >= dumpPasses) {
+                std::vector<float> pixels;
+                accumulation[currentTarget].resolve(pixels);
+                if (hdrImage::writePFM(dumpPath, scene::screenWidth, scene::screenHeight, pixels.data())) std::cout << "Wrote " << dumpPath << " after " << accumulatedPasses << " passes" << std::endl;
+                else std::cout << "Failed to write " << dumpPath << std::endl;
+                glfwSetWindowShouldClose(window, GLFW_TRUE);
             }
 
-            fb.bind();
-            shader.setUniform1i("u_directPass", 0);
-            renderer.draw(va, ib, shader);
-            accumulatedPasses++;
-
-            fb.unbind();
-            shader.setUniform1i("u_directPass", 1);
-            shader.setUniform1i("u_accumulatedPasses", accumulatedPasses);
+            accumulation[currentTarget].bindTexture(0);
+            shader.setUniform1i(directPassUniform, 1);
             renderer.draw(va, ib, shader);
 
             gui.render();
@@ -15,6 +15,62 @@ bool GLLogCall(const char* function, const char* file, int line) {
     return true;
 }
 
+glCallSite lastGLCall = { nullptr, nullptr, 0 };
+
+namespace {
+    const char* debugSourceName(GLenum source) {
+        switch (source) {
+        case GL_DEBUG_SOURCE_API: return "api";
+        case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "window system";
+        case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+        case GL_DEBUG_SOURCE_THIRD_PARTY: return "third party";
+        case GL_DEBUG_SOURCE_APPLICATION: return "application";
+        default: return "other";
+        }
+    }
+
+    const char* debugTypeName(GLenum type) {
+        switch (type) {
+        case GL_DEBUG_TYPE_ERROR: return "Error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "Deprecated";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "Undefined Behavior";
+        case GL_DEBUG_TYPE_PORTABILITY: return "Portability";
+        case GL_DEBUG_TYPE_PERFORMANCE: return "Performance";
+        default: return "Message";
+        }
+    }
+
+    void GLAPIENTRY debugCallback(GLenum source, GLenum type, GLuint id, GLenum /*severity*/, GLsizei /*length*/, const GLchar* message, const void* /*userParam*/) {
+        std::cout << "[OpenGL " << debugTypeName(type) << "] (" << id << ", " << debugSourceName(source) << "): " << message << std::endl;
+        if (lastGLCall.function) {
+            std::cout << "    last call: " << lastGLCall.function << " in " << lastGLCall.file << ": " << lastGLCall.line << std::endl;
+        }
+#ifdef GL_CALL_SITES
+        if (type == GL_DEBUG_TYPE_ERROR) __debugbreak();
+#endif
+    }
+}
+
+// hooks up the KHR_debug callback, needs 4.3 or the extension (a debug context gets a lot more out of the driver)
+// with GL_SYNC_CHECKS the old glGetError checks already catch everything so this does nothing
+void GLEnableDebugOutput() {
+#ifndef GL_SYNC_CHECKS
+    if (!GLEW_VERSION_4_3 && !GLEW_KHR_debug) {
+        std::cout << "Debug output isn't supported, GL errors won't be reported" << std::endl;
+        return;
+    }
+
+    glEnable(GL_DEBUG_OUTPUT);
+#ifdef GL_CALL_SITES
+    // the callback runs inside the failing call so lastGLCall is the call that caused it
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+#endif
+    glDebugMessageCallback(debugCallback, nullptr);
+    // notifications are things like buffer placement info, way too chatty
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+#endif
+}
+
 void renderer::clear() const {
     call(glClear(GL_COLOR_BUFFER_BIT));
 }
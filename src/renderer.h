@@ -7,13 +7,42 @@
 #include "glabstraction/vertexArray.h"
 
 // debugging stuff
+// GL_SYNC_CHECKS  glGetError after every call and break on the one that failed, every check is a round trip to the driver
+// _DEBUG          call only remembers its call site, errors come in through the debug output callback (synchronous, so the site is right)
+// otherwise       call(x) is just x, the callback still prints whatever the driver reports but without a call site
+// the first two are several statements and call also wraps declarations (call(int x = glFoo())), so it can't be a
+// single statement. a call under an if, else, for or while always needs braces around it
 #define assert(x) if (!(x)) __debugbreak();
+#if defined(GL_SYNC_CHECKS)
 #define call(x) GLClearError();\
 x;\
 assert(GLLogCall(#x, __FILE__, __LINE__))
+#elif defined(_DEBUG)
+#define GL_CALL_SITES
+#define call(x) GLRecordCall(#x, __FILE__, __LINE__);\
+x
+#else
+#define call(x) x
+#endif
 
 void GLClearError();
 bool GLLogCall(const char* function, const char* file, int line);
+void GLEnableDebugOutput();
+
+// last call made through call(x), the debug callback reports errors against it
+struct glCallSite {
+	const char* function;
+	const char* file;
+	int line;
+};
+
+extern glCallSite lastGLCall;
+
+inline void GLRecordCall(const char* function, const char* file, int line) {
+	lastGLCall.function = function;
+	lastGLCall.file = file;
+	lastGLCall.line = line;
+}
 
 class renderer {
 public:
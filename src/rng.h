@@ -0,0 +1,26 @@
+#pragma once
+
+// integer hashing rng shared by the cpu renderer and the gl loop, the same functions are in raytrace.shader
+// everything is a pure function of its inputs so a fixed seed reproduces a render bit for bit
+namespace rng {
+	// pcg output permutation used as a plain integer hash (Jarzynski and Olano, "Hash Functions for GPU Rendering")
+	inline unsigned int hash(unsigned int x) {
+		unsigned int state = x * 747796405u + 2891336453u;
+		unsigned int word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+		return (word >> 22u) ^ word;
+	}
+
+	inline unsigned int hashCombine(unsigned int seed, unsigned int v) {
+		return seed ^ (hash(v) + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+	}
+
+	// top 24 bits to [0, 1)
+	inline float toFloat(unsigned int x) {
+		return (float)(x >> 8) / 16777216.0f;
+	}
+
+	// one uniform number per (seed, key), for per pass values like u_schlickPass
+	inline float uniform(unsigned int seed, unsigned int key) {
+		return toFloat(hash(hashCombine(hash(seed), key)));
+	}
+}
@@ -2,12 +2,90 @@
 
 #include <algorithm>
 
+#include "aliasTable.h"
+#include "bvh.h"
 #include "glabstraction/shader.h"
+#include "glabstraction/storageBuffer.h"
 
 bool compare3f(float* f1, float* f2) {
 	return (f1[0] == f2[0] && f1[1] == f2[1] && f1[2] == f2[2]);
 }
 
+namespace {
+	const float PI = 3.1415926538f;
+
+	// what changed since the last upload, a resize means the whole buffer goes up again
+	std::vector<unsigned char> objectDirty;
+	std::vector<unsigned char> lightDirty;
+	std::vector<unsigned char> materialDirty;
+	bool objectsResized = true;
+	bool lightsResized = true;
+	bool materialsResized = true;
+	bool geometryDirty = true;
+	bool emittersDirty = true; // any object or material edit can add or remove an emitter
+	unsigned int dirtyProperties = scene::PROPERTY_ALL;
+
+	unsigned int objectVersion = 0;
+	unsigned int geometryVersion = 0;
+	unsigned int lightVersion = 0;
+	unsigned int materialVersion = 0;
+	unsigned int propertyVersion = 0;
+
+	// handles for everything the scene uploads, resolved again if currShader changes
+	struct sceneUniforms {
+		const shader* owner = nullptr;
+		uniformHandle shadowRays, lightSamples, reservoirCandidates, screenSize, lightBounces, rouletteDepth, samplerType, seed;
+		uniformHandle skyboxGamma, skyboxStrength, planeVisible;
+		uniformHandle planeMaterial;
+		uniformHandle objectCount, lightCount, emitterCount, bvhNodeCount, lightBVHNodeCount;
+	};
+	sceneUniforms uniforms;
+
+	sceneUniforms& getUniforms() {
+		shader& s = *scene::currShader;
+		if (uniforms.owner == &s) return uniforms;
+
+		uniforms.owner = &s;
+		uniforms.shadowRays = s.getUniform("u_shadowRays");
+		uniforms.lightSamples = s.getUniform("u_lightSamples");
+		uniforms.reservoirCandidates = s.getUniform("u_reservoirCandidates");
+		uniforms.screenSize = s.getUniform("u_screenSize");
+		uniforms.lightBounces = s.getUniform("u_lightBounces");
+		uniforms.rouletteDepth = s.getUniform("u_rouletteDepth");
+		uniforms.samplerType = s.getUniform("u_samplerType");
+		uniforms.seed = s.getUniform("u_seed");
+		uniforms.skyboxGamma = s.getUniform("u_skyboxGamma");
+		uniforms.skyboxStrength = s.getUniform("u_skyboxStrength");
+		uniforms.planeVisible = s.getUniform("u_planeVisible");
+		uniforms.planeMaterial = s.getUniform("u_planeMaterial");
+		uniforms.objectCount = s.getUniform("u_objectCount");
+		uniforms.lightCount = s.getUniform("u_lightCount");
+		uniforms.emitterCount = s.getUniform("u_emitterCount");
+		uniforms.bvhNodeCount = s.getUniform("u_bvhNodeCount");
+		uniforms.lightBVHNodeCount = s.getUniform("u_lightBVHNodeCount");
+		return uniforms;
+	}
+
+	// uploads every run of consecutive dirty entries with one sub data call each
+	template<typename gpuType, typename type>
+	void uploadDirtyRanges(storageBuffer* buffer, const std::vector<type>& items, std::vector<unsigned char>& dirty) {
+		unsigned int i = 0;
+		while (i < items.size()) {
+			if (!dirty[i]) {
+				i++;
+				continue;
+			}
+			unsigned int first = i;
+			std::vector<gpuType> packed;
+			while (i < items.size() && dirty[i]) {
+				packed.push_back(gpuType(items[i]));
+				dirty[i++] = 0;
+			}
+			buffer->setSubData(first * sizeof(gpuType), packed.data(), (unsigned int)(packed.size() * sizeof(gpuType)));
+		}
+	}
+}
+
 namespace scene {
 	std::vector<object> objects;
 	std::vector<pointLight> lights;
@@ -15,6 +93,18 @@ namespace scene {
 	int planeMaterial = 0;
 
 	shader* currShader;
+	storageBuffer* bvhNodeBuffer = nullptr;
+	storageBuffer* bvhIndexBuffer = nullptr;
+	storageBuffer* objectBuffer = nullptr;
+	storageBuffer* lightBuffer = nullptr;
+	storageBuffer* lightAliasBuffer = nullptr;
+	storageBuffer* emitterBuffer = nullptr;
+	storageBuffer* lightBVHNodeBuffer = nullptr;
+	storageBuffer* lightBVHIndexBuffer = nullptr;
+	storageBuffer* reservoirBuffer = nullptr;
+	storageBuffer* materialBuffer = nullptr;
+	bvh objectBVH;
+	bvh lightBVH;
 
 	int selectedObjectIndex = 0;
 	bool planeSelected = false;
@@ -24,11 +114,22 @@ namespace scene {
 	// properties
 	int screenWidth = 0;
 	int screenHeight = 0;
-	int shadowResolution = 50;
+	int shadowRays = 1;
+	int lightSamples = 1;
+	int reservoirCandidates = 0;
 	int lightBounces = 10;
+	int rouletteDepth = 3;
+	int samplingMethod = 1; // sobol
+	int randomSeed = 0;
 	float skyboxGamma = 2.2f;
 	float skyboxStrength = 0.4f;
 	bool planeVisible = true;
+	bool computeMode = false;
+	int computeTileSize = 256;
+	int computeTileBudget = 0;
+	bool computeWavefront = false;
+	int samplesPerPresent = 1;
+	bool hotReload = true;
 
 	material::material() {
 		this->id = materials.size();
@@ -141,43 +242,308 @@ namespace scene {
 		else return false;
 	}
 
+	gpuMaterial::gpuMaterial(const material& m) {
+		for (int i = 0; i < 3; i++) {
+			this->albedo[i] = m.albedo[i];
+			this->emission[i] = m.emission[i];
+			this->specular[i] = m.specular[i];
+		}
+		this->emissionStrength = m.emissionStrength;
+		this->roughness = m.roughness;
+		this->specularHighlight = m.specularHighlight;
+		this->specularExponent = m.specularExponent;
+		this->transparent = m.transparent;
+		this->refractiveIndex = m.refractiveIndex;
+		this->padding = 0.0f;
+	}
+
+	gpuObject::gpuObject(const object& o) {
+		for (int i = 0; i < 3; i++) {
+			this->position[i] = o.position[i];
+			this->scale[i] = o.scale[i];
+		}
+		this->type = o.type;
+		this->material = o.mat;
+	}
+
+	gpuLight::gpuLight(const pointLight& l) {
+		for (int i = 0; i < 3; i++) {
+			this->position[i] = l.position[i];
+			this->color[i] = l.color[i];
+			this->padding[i] = 0.0f;
+		}
+		this->radius = l.radius;
+		this->power = l.power;
+		this->reach = l.reach;
+	}
+
+	// the starting scene, shared by the window and the headless renderer
+	void loadDefaultScene() {
+		addMaterial(material());
+		addMaterial(material({ 1.0f, 1.0f, 1.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, 0.0f, 1.0f, 0.0f, 0.0f, true, 1.5f));
+		addObject(object(1, { 1.0f, 1.0f, 1.0f }, { 1.0f, 1.0f, 1.0f }, 1));
+		addLight(pointLight({ 2.0f, 8.0f, -1.0f }, 2.0f, { 1.0f, 1.0f, 1.0f }, 20.0f, 30.0f));
+	}
+
+	// only the properties marked since the last call get sent
 	void setProperties() {
-		(*currShader).setUniform1i("u_shadowResolution", shadowResolution);
-		(*currShader).setUniform1i("u_lightBounces", lightBounces);
-		(*currShader).setUniform1f("u_skyboxGamma", skyboxGamma);
-		(*currShader).setUniform1f("u_skyboxStrength", skyboxStrength);
-		(*currShader).setUniform1i("u_planeVisible", planeVisible);
-		(*currShader).setUniformMaterial("u_planeMaterial", scene::materials[planeMaterial]);
+		if (dirtyProperties == 0) return;
+		const sceneUniforms& u = getUniforms();
+		if (dirtyProperties & PROPERTY_SHADOW_RAYS) (*currShader).setUniform1i(u.shadowRays, shadowRays);
+		if (dirtyProperties & PROPERTY_LIGHT_SAMPLES) (*currShader).setUniform1i(u.lightSamples, lightSamples);
+		if (dirtyProperties & PROPERTY_RESERVOIR_CANDIDATES) {
+			(*currShader).setUniform1i(u.reservoirCandidates, reservoirCandidates);
+			(*currShader).setUniform2i(u.screenSize, screenWidth, screenHeight);
+			// two halves of a reservoir per pixel, they start out empty
+			unsigned int size = (unsigned int)((size_t)screenWidth * screenHeight * 2 * sizeof(gpuReservoir));
+			if (reservoirBuffer && reservoirCandidates > 0 && reservoirBuffer->getSize() < size) {
+				reservoirBuffer->allocate(size);
+				reservoirBuffer->clear(0, size);
+			}
+		}
+		if (dirtyProperties & PROPERTY_LIGHT_BOUNCES) (*currShader).setUniform1i(u.lightBounces, lightBounces);
+		if (dirtyProperties & PROPERTY_ROULETTE_DEPTH) (*currShader).setUniform1i(u.rouletteDepth, rouletteDepth);
+		if (dirtyProperties & PROPERTY_SAMPLING_METHOD) (*currShader).setUniform1i(u.samplerType, samplingMethod);
+		if (dirtyProperties & PROPERTY_RANDOM_SEED) (*currShader).setUniform1i(u.seed, randomSeed);
+		if (dirtyProperties & PROPERTY_SKYBOX_GAMMA) (*currShader).setUniform1f(u.skyboxGamma, skyboxGamma);
+		if (dirtyProperties & PROPERTY_SKYBOX_STRENGTH) (*currShader).setUniform1f(u.skyboxStrength, skyboxStrength);
+		if (dirtyProperties & PROPERTY_PLANE_VISIBLE) (*currShader).setUniform1i(u.planeVisible, planeVisible);
+		if (dirtyProperties & PROPERTY_PLANE_MATERIAL) (*currShader).setUniform1i(u.planeMaterial, planeMaterial);
 		// other properties
+		dirtyProperties = 0;
 	}
 
-	void updateObjects() {
+	void clearReservoirs() {
+		if (reservoirBuffer) reservoirBuffer->clear(0, reservoirBuffer->getSize());
+	}
+
+	// a feature that's off compiles its branch away. only whether it's on goes in, the counts stay uniforms so there
+	// are at most 64 permutations however many lights get added or slider steps get dragged through
+	shaderDefines getShaderDefines() {
+		bool transparency = false;
+		for (const material& m : materials) transparency = transparency || m.transparent;
+
+		return {
+			{ "FEATURE_PLANE", planeVisible ? 1 : 0 },
+			{ "FEATURE_TRANSPARENCY", transparency ? 1 : 0 },
+			{ "FEATURE_LIGHTS", lights.empty() ? 0 : 1 },
+			{ "FEATURE_EMITTERS", findEmitters().empty() ? 0 : 1 },
+			{ "FEATURE_LIGHT_SAMPLING", lightSamples > 0 ? 1 : 0 },
+			{ "FEATURE_RESERVOIRS", reservoirCandidates > 0 ? 1 : 0 }
+		};
+	}
+
+	std::vector<int> findEmitters() {
+		std::vector<int> emitters;
 		for (unsigned int i = 0; i < objects.size(); i++) {
-			(*currShader).setUniformObject(objects[i], i);
+			const material& m = materials[objects[i].mat];
+			if (m.emissionStrength > 0.0f && (m.emission[0] > 0.0f || m.emission[1] > 0.0f || m.emission[2] > 0.0f)) emitters.push_back((int)i);
+		}
+		return emitters;
+	}
+
+	// how much a light can add anywhere, its power times the luminance of its color. reach and distance depend on
+	// the shading point so they're left to the shader, it just throws the sample away when a light is out of reach.
+	// an emitter gets its radiance times its area over 4 pi, the same scale a light's color * power / r^2 ends up on
+	void buildLightTable(aliasTable& table, const std::vector<int>& emitters) {
+		std::vector<float> weights;
+		for (const pointLight& l : lights) {
+			weights.push_back(l.power * (0.2126f * l.color[0] + 0.7152f * l.color[1] + 0.0722f * l.color[2]));
+		}
+		for (int i : emitters) {
+			const object& o = objects[i];
+			const material& m = materials[o.mat];
+			float area = o.type == SPHERE ? 4.0f * PI * o.scale[0] * o.scale[0] : 2.0f * (o.scale[0] * o.scale[1] + o.scale[1] * o.scale[2] + o.scale[0] * o.scale[2]);
+			weights.push_back(m.emissionStrength * (0.2126f * m.emission[0] + 0.7152f * m.emission[1] + 0.0722f * m.emission[2]) * area / (4.0f * PI));
+		}
+		table.build(weights);
+	}
+
+	// every light as a sphere object so the object bvh can be built over them, the ones the shader treats as points
+	// (radius under its EPSILON) as type none
+	void buildLightBVH(bvh& tree) {
+		std::vector<object> spheres;
+		for (const pointLight& l : lights) {
+			spheres.push_back(object(l.radius > 0.0001f ? SPHERE : 0, { l.position[0], l.position[1], l.position[2] }, { l.radius, l.radius, l.radius }, 0));
+		}
+		tree.build(spheres);
+	}
+
+	// a resize packs every object into one upload, otherwise only the marked ranges are sent
+	// the shader only reads the first u_objectCount entries
+	void updateObjects() {
+		objectDirty.resize(objects.size(), 1);
+		if (objectBuffer) {
+			if (objectsResized) {
+				std::vector<gpuObject> packed(objects.begin(), objects.end());
+				objectBuffer->setData(packed.data(), (unsigned int)(packed.size() * sizeof(gpuObject)));
+			}
+			else {
+				uploadDirtyRanges<gpuObject>(objectBuffer, objects, objectDirty);
+			}
 		}
+		std::fill(objectDirty.begin(), objectDirty.end(), 0);
+		if (objectsResized) (*currShader).setUniform1i(getUniforms().objectCount, (int)objects.size());
+		objectsResized = false;
+
+		// objects only hold a material index so the bvh is only rebuilt for geometry changes
+		if (!geometryDirty) return;
+		geometryDirty = false;
+
+		// rebuild the bvh and hand the flattened tree to the shader
+		objectBVH.build(objects);
+		const std::vector<bvhNode>& nodes = objectBVH.getNodes();
+		const std::vector<unsigned int>& indices = objectBVH.getIndices();
+		if (bvhNodeBuffer && bvhIndexBuffer && !nodes.empty()) {
+			bvhNodeBuffer->setData(nodes.data(), (unsigned int)(nodes.size() * sizeof(bvhNode)));
+			bvhIndexBuffer->setData(indices.data(), (unsigned int)(indices.size() * sizeof(unsigned int)));
+		}
+		(*currShader).setUniform1i(getUniforms().bvhNodeCount, (int)nodes.size());
 	}
 
 	void updateLights() {
-		for (unsigned int i = 0; i < lights.size(); i++) {
-			(*currShader).setUniformLight(lights[i], i);
+		lightDirty.resize(lights.size(), 1);
+		bool lightsChanged = lightsResized || std::find(lightDirty.begin(), lightDirty.end(), 1) != lightDirty.end();
+		if (lightsChanged) {
+			buildLightBVH(lightBVH);
+			const std::vector<bvhNode>& nodes = lightBVH.getNodes();
+			const std::vector<unsigned int>& indices = lightBVH.getIndices();
+			if (lightBVHNodeBuffer && lightBVHIndexBuffer && !nodes.empty()) {
+				lightBVHNodeBuffer->setData(nodes.data(), (unsigned int)(nodes.size() * sizeof(bvhNode)));
+				lightBVHIndexBuffer->setData(indices.data(), (unsigned int)(indices.size() * sizeof(unsigned int)));
+			}
+			(*currShader).setUniform1i(getUniforms().lightBVHNodeCount, (int)nodes.size());
 		}
+
+		// any edit can move the weights around, the whole table gets rebuilt but it's one pass over the lights and objects
+		if (lightsChanged || emittersDirty) {
+			std::vector<int> emitters = findEmitters();
+			if (lightAliasBuffer) {
+				aliasTable table;
+				buildLightTable(table, emitters);
+				// with no weight at all every entry has a pdf of 0 and the shader skips the sample
+				std::vector<aliasEntry> entries = table.empty() ? std::vector<aliasEntry>(std::max(lights.size() + emitters.size(), (size_t)1), aliasEntry()) : table.getEntries();
+				lightAliasBuffer->setData(entries.data(), (unsigned int)(entries.size() * sizeof(aliasEntry)));
+			}
+			if (emitterBuffer && emittersDirty) {
+				// the buffer can't be empty, the shader never reads past u_emitterCount anyway
+				std::vector<int> packed = emitters.empty() ? std::vector<int>(1, -1) : emitters;
+				emitterBuffer->setData(packed.data(), (unsigned int)(packed.size() * sizeof(int)));
+				(*currShader).setUniform1i(getUniforms().emitterCount, (int)emitters.size());
+			}
+			emittersDirty = false;
+		}
+		if (lightBuffer) {
+			if (lightsResized) {
+				std::vector<gpuLight> packed(lights.begin(), lights.end());
+				lightBuffer->setData(packed.data(), (unsigned int)(packed.size() * sizeof(gpuLight)));
+			}
+			else {
+				uploadDirtyRanges<gpuLight>(lightBuffer, lights, lightDirty);
+			}
+		}
+		std::fill(lightDirty.begin(), lightDirty.end(), 0);
+		if (lightsResized) (*currShader).setUniform1i(getUniforms().lightCount, (int)lights.size());
+		lightsResized = false;
+	}
+
+	// objects and the plane only point at a material, so an edit is one entry of the material buffer
+	void updateMaterials() {
+		materialDirty.resize(materials.size(), 1);
+		if (materialBuffer) {
+			if (materialsResized) {
+				std::vector<gpuMaterial> packed(materials.begin(), materials.end());
+				materialBuffer->setData(packed.data(), (unsigned int)(packed.size() * sizeof(gpuMaterial)));
+			}
+			else {
+				uploadDirtyRanges<gpuMaterial>(materialBuffer, materials, materialDirty);
+			}
+		}
+		std::fill(materialDirty.begin(), materialDirty.end(), 0);
+		materialsResized = false;
+	}
+
+	void markObject(unsigned int index) {
+		if (index < objectDirty.size()) objectDirty[index] = 1;
+		geometryDirty = true;
+		emittersDirty = true;
+		objectVersion++;
+		geometryVersion++;
+	}
+
+	void markLight(unsigned int index) {
+		if (index < lightDirty.size()) lightDirty[index] = 1;
+		lightVersion++;
+	}
+
+	void markMaterial(unsigned int index) {
+		if (index < materialDirty.size()) materialDirty[index] = 1;
+		emittersDirty = true;
+		materialVersion++;
+	}
+
+	void markProperties(unsigned int flags) {
+		dirtyProperties |= flags;
+		propertyVersion++;
+	}
+
+	// the buffers are shared between programs but the counts and properties are uniforms, so they have to go again too
+	void markAll() {
+		objectsResized = true;
+		lightsResized = true;
+		materialsResized = true;
+		geometryDirty = true;
+		emittersDirty = true;
+		dirtyProperties = PROPERTY_ALL;
+	}
+
+	unsigned int getObjectVersion() {
+		return objectVersion;
+	}
+
+	unsigned int getGeometryVersion() {
+		return geometryVersion;
+	}
+
+	unsigned int getLightVersion() {
+		return lightVersion;
+	}
+
+	unsigned int getMaterialVersion() {
+		return materialVersion;
+	}
+
+	unsigned int getPropertyVersion() {
+		return propertyVersion;
 	}
 
 	void addObject(object o) {
 		objects.push_back(o);
+		objectsResized = true;
+		markObject(objects.size() - 1);
 	}
 
 	void removeObject(unsigned int index) {
 		objects.erase(objects.begin() + index);
-		(*currShader).setUniformObject(object(), index); // erases from world
+		objectsResized = true;
+		markObject(index);
 	}
 
 	void addLight(pointLight l) {
 		lights.push_back(l);
+		lightsResized = true;
+		markLight(lights.size() - 1);
 	}
 
 	void removeLight(unsigned int index) {
 		lights.erase(lights.begin() + index);
-		(*currShader).setUniformLight(pointLight(), index); // erases from world
+		lightsResized = true;
+		markLight(index);
+	}
+
+	void addMaterial(material m) {
+		materials.push_back(m);
+		materialsResized = true;
+		markMaterial(materials.size() - 1);
 	}
 }
\ No newline at end of file
@@ -3,10 +3,14 @@
 #include <initializer_list>
 #include <vector>
 
+#include "glabstraction/shader.h"
+
 #define SPHERE 1
 #define CUBE 2
 
-class shader;
+class aliasTable;
+class bvh;
+class storageBuffer;
 
 namespace scene {
 	struct material {
@@ -50,12 +54,86 @@ namespace scene {
 		bool operator!=(pointLight l);
 	};
 
+	// std430 layouts of the Material, Object and PointLight structs in raytrace.shader
+	// every vec3 is followed by a float (or padding) so nothing lands on an implicit 16 byte boundary
+	struct gpuMaterial {
+		float albedo[3];
+		float emissionStrength;
+		float emission[3];
+		float roughness;
+		float specular[3];
+		float specularHighlight;
+		float specularExponent;
+		int transparent; // glsl bools are 4 bytes in a buffer
+		float refractiveIndex;
+		float padding;
+
+		gpuMaterial(const material& m);
+	};
+
+	struct gpuObject {
+		float position[3];
+		unsigned int type;
+		float scale[3];
+		int material; // index into the material buffer
+
+		gpuObject(const object& o);
+	};
+
+	struct gpuLight {
+		float position[3];
+		float radius;
+		float color[3];
+		float power;
+		float reach;
+		float padding[3];
+
+		gpuLight(const pointLight& l);
+	};
+
+	// matches struct Reservoir in raytrace.shader and its packReservoir, the cpu renderer keeps its own the same way.
+	// value initialized (all zeros) is empty, no candidates behind it
+	struct gpuReservoir {
+		unsigned int u; // two unorm16s
+		unsigned int slotConfidence; // the slot in the low 20 bits, M above it
+		float weight;
+		unsigned int normalDepth; // octahedral normal in two snorm8s, the depth as a half above it
+	};
+
+	// one bit per property uploaded by setProperties
+	enum propertyFlags : unsigned int {
+		PROPERTY_SHADOW_RAYS = 1 << 0,
+		PROPERTY_LIGHT_BOUNCES = 1 << 1,
+		PROPERTY_ROULETTE_DEPTH = 1 << 2,
+		PROPERTY_SAMPLING_METHOD = 1 << 3,
+		PROPERTY_RANDOM_SEED = 1 << 4,
+		PROPERTY_SKYBOX_GAMMA = 1 << 5,
+		PROPERTY_SKYBOX_STRENGTH = 1 << 6,
+		PROPERTY_PLANE_VISIBLE = 1 << 7,
+		PROPERTY_PLANE_MATERIAL = 1 << 8,
+		PROPERTY_LIGHT_SAMPLES = 1 << 9,
+		PROPERTY_RESERVOIR_CANDIDATES = 1 << 10,
+		PROPERTY_ALL = (1 << 11) - 1
+	};
+
 	extern std::vector<object> objects;
 	extern std::vector<pointLight> lights;
 	extern std::vector<material> materials;
 	extern int planeMaterial;
 
 	extern shader* currShader;
+	extern storageBuffer* bvhNodeBuffer;
+	extern storageBuffer* bvhIndexBuffer;
+	extern storageBuffer* objectBuffer;
+	extern storageBuffer* lightBuffer;
+	extern storageBuffer* lightAliasBuffer;
+	extern storageBuffer* emitterBuffer;
+	extern storageBuffer* lightBVHNodeBuffer;
+	extern storageBuffer* lightBVHIndexBuffer;
+	extern storageBuffer* reservoirBuffer; // sized for the screen the first time reservoirs get turned on
+	extern storageBuffer* materialBuffer;
+	extern bvh objectBVH;
+	extern bvh lightBVH;
 
 	extern int selectedObjectIndex;
 	extern bool planeSelected;
@@ -64,17 +142,51 @@ namespace scene {
 	
 	// properties
 	extern int screenWidth, screenHeight;
-	extern int shadowResolution;
+	extern int shadowRays;
+	extern int lightSamples; // lights and emitters picked per shading point by power with one shadow ray each, 0 shades every one of them with shadowRays rays
+	extern int reservoirCandidates; // lights resampled per pixel at the first hit with reservoirs kept between passes, 0 to sample them like every other hit
 	extern int lightBounces;
+	extern int rouletteDepth; // bounces before russian roulette can end a path
+	extern int samplingMethod; // 0 random, 1 sobol, 2 blue noise
+	extern int randomSeed; // every random number is a hash of this, the pixel, the pass and the dimension
 	extern float skyboxGamma;
 	extern float skyboxStrength;
 	extern bool planeVisible;
+	extern bool computeMode; // accumulation pass through the compute stage instead of the fragment one
+	extern int computeTileSize; // pixels, rounded up to whole work groups
+	extern int computeTileBudget; // tiles dispatched per frame, 0 for a whole pass every frame
+	extern bool computeWavefront; // compute pass a stage at a time over queued paths instead of whole paths per invocation
+	extern int samplesPerPresent; // accumulation passes between two buffer swaps
+	extern bool hotReload; // recompile the shaders when their files change on disk
 
-	void updateObjects();
+	void loadDefaultScene();
+	void updateObjects(); // only uploads what was marked since the last call
 	void updateLights();
+	void updateMaterials();
 	void setProperties();
+	void clearReservoirs(); // empties both halves for an accumulation that starts over, after a barrier on the last pass's writes
+	shaderDefines getShaderDefines(); // the FEATURE_ defines raytrace.shader gets specialized on
+	std::vector<int> findEmitters(); // objects with an emissive material, light sampling treats them as lights after the point lights
+	void buildLightTable(aliasTable& table, const std::vector<int>& emitters); // both renderers pick lights from this
+	void buildLightBVH(bvh& tree); // the light spheres for bounce rays to hit, lights with no radius are left out
+
+	// edits go through these so the update functions know what changed
+	void markObject(unsigned int index);
+	void markLight(unsigned int index);
+	void markMaterial(unsigned int index);
+	void markProperties(unsigned int flags);
+	void markAll(); // for when currShader switches to a program that has never seen the scene
+
+	// bumped on every mark, anything caching scene data compares these instead of the data itself
+	unsigned int getObjectVersion();
+	unsigned int getGeometryVersion(); // only the changes that move the bvh, not material edits
+	unsigned int getLightVersion();
+	unsigned int getMaterialVersion();
+	unsigned int getPropertyVersion();
+
 	void addObject(object o);
 	void removeObject(unsigned int index);
 	void addLight(pointLight l);
 	void removeLight(unsigned int index);
+	void addMaterial(material m);
 }
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "skyboxDistribution.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+namespace {
+	const float PI = 3.1415926538f;
+}
+
+skyboxDistribution::skyboxDistribution() : m_width(0), m_height(0), m_buildSeconds(0.0), m_buildThreads(0) {
+
+}
+
+void skyboxDistribution::build(const float* pixels, int width, int height, int channels, float gamma, unsigned int threadCount) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	m_table.build(std::vector<float>());
+	m_width = 0;
+	m_height = 0;
+	m_buildSeconds = 0.0;
+	m_buildThreads = 0;
+	if (!pixels || width <= 0 || height <= 0 || channels < 3) return;
+
+	// at least a texel per cell, so every cell has an average
+	m_width = std::min(width, SKYBOX_CELLS_ACROSS);
+	m_height = std::max(1, std::min(height, (int)std::lround((double)m_width * height / width)));
+	if (threadCount == 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+	threadCount = std::min(threadCount, (unsigned int)m_height);
+
+	// a texel belongs to the cell its index scales down to, cell c starts at the first texel with floor(t * cells / texels) == c
+	std::vector<int> firstColumn(m_width + 1);
+	for (int c = 0; c <= m_width; c++) firstColumn[c] = (int)(((long long)c * width + m_width - 1) / m_width);
+
+	// every thread owns a band of cell rows, so nothing it writes is shared
+	std::vector<float> weights((size_t)m_width * m_height);
+	float exponent = 1.0f / gamma;
+	auto sumRows = [&](int firstRow, int lastRow) {
+		std::vector<float> sums(m_width);
+		for (int row = firstRow; row < lastRow; row++) {
+			int firstY = (int)(((long long)row * height + m_height - 1) / m_height);
+			int lastY = (int)(((long long)(row + 1) * height + m_height - 1) / m_height);
+			std::fill(sums.begin(), sums.end(), 0.0f);
+			for (int y = firstY; y < lastY; y++) {
+				// the rows go from straight down to straight up, so a row covers cos(elevation) of the solid angle at the equator
+				float cosElevation = std::sin((y + 0.5f) / height * PI);
+				const float* texel = pixels + (size_t)y * width * channels;
+				for (int c = 0; c < m_width; c++) {
+					float sum = 0.0f;
+					for (int x = firstColumn[c]; x < firstColumn[c + 1]; x++, texel += channels) {
+						sum += 0.2126f * std::pow(std::max(texel[0], 0.0f), exponent) + 0.7152f * std::pow(std::max(texel[1], 0.0f), exponent) + 0.0722f * std::pow(std::max(texel[2], 0.0f), exponent);
+					}
+					sums[c] += sum * cosElevation;
+				}
+			}
+			for (int c = 0; c < m_width; c++) {
+				weights[(size_t)row * m_width + c] = sums[c] / ((lastY - firstY) * (firstColumn[c + 1] - firstColumn[c]));
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < threadCount; i++) {
+		threads.emplace_back(sumRows, (int)((long long)m_height * i / threadCount), (int)((long long)m_height * (i + 1) / threadCount));
+	}
+	sumRows(0, m_height / threadCount);
+	for (std::thread& t : threads) t.join();
+
+	m_table.build(weights);
+	if (m_table.empty()) {
+		m_width = 0;
+		m_height = 0;
+	}
+	m_buildThreads = threadCount;
+	m_buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// same mapping as sampleSkybox the other way around, u is the azimuth and v the elevation
+glm::vec3 skyboxDistribution::sample(glm::vec2 u, glm::vec2 v, float& pdf) const {
+	pdf = 0.0f;
+	if (m_table.empty()) return glm::vec3(0.0f, 1.0f, 0.0f);
+
+	int cell = m_table.sample(u.x, u.y);
+	glm::vec2 uv = (glm::vec2((float)(cell % m_width), (float)(cell / m_width)) + v) / glm::vec2((float)m_width, (float)m_height);
+	float azimuth = (uv.x - 0.5f) * 2.0f * PI;
+	float elevation = (uv.y - 0.5f) * PI;
+	float cosElevation = std::cos(elevation);
+	// uniform over the cell in uv, and a bit of uv covers 2 pi^2 cos(elevation) of solid angle
+	if (cosElevation > 0.0f) pdf = m_table.pdf(cell) * m_width * m_height / (2.0f * PI * PI * cosElevation);
+	return glm::vec3(cosElevation * std::sin(azimuth), std::sin(elevation), cosElevation * std::cos(azimuth));
+}
+
+float skyboxDistribution::pdf(glm::vec3 direction) const {
+	if (m_table.empty()) return 0.0f;
+	float cosElevation = std::sqrt(std::max(1.0f - direction.y * direction.y, 0.0f));
+	if (cosElevation <= 0.0f) return 0.0f;
+
+	float u = 0.5f + std::atan2(direction.x, direction.z) / (2.0f * PI);
+	float v = 0.5f + std::asin(glm::clamp(direction.y, -1.0f, 1.0f)) / PI;
+	int x = glm::clamp((int)(u * m_width), 0, m_width - 1);
+	int y = glm::clamp((int)(v * m_height), 0, m_height - 1);
+	return m_table.pdf(y * m_width + x) * m_width * m_height / (2.0f * PI * PI * cosElevation);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "aliasTable.h"
+
+#include <glm/glm.hpp>
+
+#define SKYBOX_CELLS_ACROSS 1024 // most cells the table has per row, the rows follow the image's aspect ratio
+
+// importance sampling for the equirect skybox, so the sky can be sampled as a light instead of only being found by paths
+// that escape. the image is cut into cells of a few texels, each weighted by its luminance (after the skybox gamma) times
+// the solid angle it covers, and an aliasTable picks one. the direction is then uniform over the picked cell.
+// built once the sky is loaded with the gamma at that point, changing it later keeps the samples unbiased since only
+// black texels have no chance, it just doesn't follow the new brightness. the same table is sampled on the cpu and
+// uploaded for the shader (u_skyboxAlias)
+class skyboxDistribution {
+private:
+	aliasTable m_table;
+	int m_width, m_height; // in cells
+	double m_buildSeconds;
+	unsigned int m_buildThreads;
+public:
+	skyboxDistribution();
+
+	// pixels are rows of channels floats, bottom row first like texture and hdrImage load them. the weights are summed
+	// up on threadCount threads (0 for one per core) since a 4k sky is millions of texels
+	void build(const float* pixels, int width, int height, int channels, float gamma, unsigned int threadCount = 0);
+
+	// u picks the cell like aliasTable::sample and v the point in it, pdf is over solid angle
+	glm::vec3 sample(glm::vec2 u, glm::vec2 v, float& pdf) const;
+	float pdf(glm::vec3 direction) const;
+
+	inline bool empty() const { return m_table.empty(); }
+	inline int getWidth() const { return m_width; }
+	inline int getHeight() const { return m_height; }
+	inline double getBuildSeconds() const { return m_buildSeconds; }
+	inline unsigned int getBuildThreads() const { return m_buildThreads; }
+	inline const std::vector<aliasEntry>& getEntries() const { return m_table.getEntries(); }
+};